@@ -0,0 +1,103 @@
+// Deterministic CSV and NDJSON datasets for the benchmarks, generated once per size and cached
+const fs = require('fs')
+const os = require('os')
+const path = require('path')
+const zlib = require('zlib')
+const { pipeline } = require('stream/promises')
+
+const DIRECTORY = path.join(os.tmpdir(), 'tranfi-bench')
+const CATEGORIES = ['alpha', 'beta', 'gamma', 'delta', 'epsilon', 'zeta', 'eta', 'theta']
+const ROWS_PER_WRITE = 10000
+
+// mulberry32, so every run sees the same rows
+function random (seed) {
+  return function () {
+    seed = (seed + 0x6D2B79F5) | 0
+    let t = Math.imul(seed ^ (seed >>> 15), 1 | seed)
+    t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296
+  }
+}
+
+function row (i, rand) {
+  return {
+    id: i,
+    category: CATEGORIES[Math.floor(rand() * CATEGORIES.length)],
+    code: String(Math.floor(rand() * 1000)).padStart(3, '0'),
+    value: Math.round(rand() * 100000) / 100,
+    score: Math.floor(rand() * 100),
+    note: rand() < 0.05 ? 'quoted, "with" commas' : 'plain text note ' + Math.floor(rand() * 100)
+  }
+}
+
+const FORMATS = {
+  csv: {
+    header: 'id,category,code,value,score,note\n',
+    line: (r) => `${r.id},${r.category},${r.code},${r.value},${r.score},${r.note.includes(',') ? '"' + r.note.replace(/"/g, '""') + '"' : r.note}\n`
+  },
+  ndjson: {
+    header: '',
+    line: (r) => JSON.stringify(r) + '\n'
+  }
+}
+
+// '10MB', '1.5GB' and plain byte counts
+function parseSize (text) {
+  const m = /^([\d.]+)\s*(B|KB|MB|GB)?$/i.exec(String(text).trim())
+  if (!m) throw new Error(`Bad size: ${text}`)
+  const units = { B: 1, KB: 1024, MB: 1024 * 1024, GB: 1024 * 1024 * 1024 }
+  return Math.round(parseFloat(m[1]) * units[(m[2] || 'B').toUpperCase()])
+}
+
+async function write (file, format, size) {
+  const out = fs.createWriteStream(file)
+  const rand = random(42)
+  const { header, line } = FORMATS[format]
+  let written = header.length
+  let i = 0
+  out.write(header)
+  while (written < size) {
+    let text = ''
+    for (let k = 0; k < ROWS_PER_WRITE && written + text.length < size; k++) {
+      text += line(row(i++, rand))
+    }
+    written += text.length
+    if (!out.write(text)) {
+      await new Promise(resolve => out.once('drain', resolve))
+    }
+  }
+  await new Promise((resolve, reject) => out.end(err => err ? reject(err) : resolve()))
+}
+
+// Path of a dataset of about `size` bytes, gzip adds a compressed copy
+async function dataset (format, size, gzip = false) {
+  fs.mkdirSync(DIRECTORY, { recursive: true })
+  const file = path.join(DIRECTORY, `${format}-${size}.${format}`)
+  if (!fs.existsSync(file)) {
+    await write(file + '.tmp', format, size)
+    fs.renameSync(file + '.tmp', file)
+  }
+  if (!gzip) return file
+  if (!fs.existsSync(file + '.gz')) {
+    await pipeline(fs.createReadStream(file), zlib.createGzip({ level: 1 }), fs.createWriteStream(file + '.gz.tmp'))
+    fs.renameSync(file + '.gz.tmp', file + '.gz')
+  }
+  return file + '.gz'
+}
+
+// Labels of the dataset categories, the lookup side of the Join benchmark
+function lookup () {
+  fs.mkdirSync(DIRECTORY, { recursive: true })
+  const file = path.join(DIRECTORY, 'lookup.csv')
+  if (!fs.existsSync(file)) {
+    fs.writeFileSync(file, 'category,label\n' + CATEGORIES.map((c, i) => `${c},label ${i}\n`).join(''))
+  }
+  return file
+}
+
+module.exports = {
+  DIRECTORY,
+  parseSize,
+  dataset,
+  lookup
+}
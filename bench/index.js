@@ -0,0 +1,183 @@
+// Headless benchmarks of transforms and pipelines over generated datasets, reporting MB/s, rows/s and peak heap.
+//   npm run bench -- --sizes 10MB,1GB --filter csv --json results.json
+// Runs under Node, so stages that need the DOM (TextOutput, TableOutput), Web Workers (Parallel modes)
+// or XHR (HTTPLoader) are not covered here.
+const fs = require('fs')
+const path = require('path')
+const { Blob } = require('buffer')
+const transforms = require('../src/transforms')
+const { build, defaultValue } = require('../src/pipeline')
+const { RecordBatch } = require('../src/batch')
+const { DIRECTORY, parseSize, dataset, lookup } = require('./datasets')
+
+const HEAP_INTERVAL = 20 // ms
+
+function stage (name, params = {}) {
+  const defaults = {}
+  new transforms[name](0).inputs.forEach(input => { defaults[input.name] = defaultValue(input) })
+  return { id: name, name, params: Object.assign(defaults, params) }
+}
+
+const FAST_BATCHES = { 'Engine': 'Fast', 'Output': 'Batches' }
+const EXTENSIONS = { 'CSV': 'csv', 'NDJSON': 'ndjson', 'Arrow': 'arrow', 'Parquet': 'parquet' }
+
+const CASES = [
+  { name: 'FileLoader', format: 'csv', stages: [] },
+  { name: 'CSVParser csv-parse objects', format: 'csv', stages: [stage('CSVParser', { 'Schema': 'Per value' })] },
+  { name: 'CSVParser csv-parse batches', format: 'csv', stages: [stage('CSVParser', { 'Output': 'Batches' })] },
+  { name: 'CSVParser fast objects', format: 'csv', stages: [stage('CSVParser', { 'Engine': 'Fast' })] },
+  { name: 'CSVParser fast batches', format: 'csv', stages: [stage('CSVParser', FAST_BATCHES)] },
+  { name: 'JSONParser ndjson', format: 'ndjson', stages: [stage('JSONParser', { 'Format': 'NDJSON' })] },
+  { name: 'Decompress gzip + csv', format: 'csv', gzip: true, stages: [stage('Decompress'), stage('CSVParser', FAST_BATCHES)] },
+  { name: 'ArrowParser', format: 'arrow', stages: [stage('ArrowParser')] },
+  { name: 'ParquetParser', format: 'parquet', stages: [stage('ParquetParser')] },
+  { name: 'Filter (pushed down)', format: 'csv', stages: [stage('CSVParser', FAST_BATCHES), stage('Filter', { 'Expression': 'score > 50' })] },
+  { name: 'Select (pushed down)', format: 'csv', stages: [stage('CSVParser', FAST_BATCHES), stage('Select', { 'Fields': 'id, value' })] },
+  {
+    name: 'Compute',
+    format: 'csv',
+    stages: [stage('CSVParser', FAST_BATCHES), stage('Compute', { 'Columns': 'total = value * score; high = score > 50' })]
+  },
+  {
+    name: 'Join',
+    format: 'csv',
+    // The lookup file is generated next to the datasets when the case runs
+    stages: () => [stage('CSVParser', FAST_BATCHES), stage('Join', { 'Lookup file': lookup(), 'Key': 'category' })]
+  },
+  {
+    name: 'Branch',
+    format: 'csv',
+    stages: [
+      stage('CSVParser', FAST_BATCHES),
+      stage('Branch'), stage('Filter', { 'Expression': 'score > 50' }),
+      stage('Branch'), stage('GroupBy', { 'Group by': 'category', 'Aggregates': 'count, sum(value)' })
+    ]
+  },
+  {
+    name: 'GroupBy',
+    format: 'csv',
+    stages: [
+      stage('CSVParser', FAST_BATCHES),
+      stage('GroupBy', { 'Group by': 'category', 'Aggregates': 'count, sum(value), mean(score), distinct(code), quantile(value, 0.95)' })
+    ]
+  },
+  { name: 'Sort', format: 'csv', stages: [stage('CSVParser', FAST_BATCHES), stage('Sort', { 'Sort by': '-value, id' })] },
+  { name: 'FileOutput csv', format: 'csv', stages: [stage('CSVParser', FAST_BATCHES)], output: 'CSV' },
+  { name: 'FileOutput ndjson', format: 'csv', stages: [stage('CSVParser', FAST_BATCHES)], output: 'NDJSON' },
+  { name: 'FileOutput arrow', format: 'csv', stages: [stage('CSVParser', FAST_BATCHES)], output: 'Arrow' },
+  { name: 'FileOutput parquet', format: 'csv', stages: [stage('CSVParser', FAST_BATCHES)], output: 'Parquet' }
+]
+
+// File-backed where Node supports it, so large datasets are not read into memory up front
+async function openBlob (file) {
+  if (fs.openAsBlob) return fs.openAsBlob(file)
+  return new Blob([fs.readFileSync(file)])
+}
+
+function countRows (chunk) {
+  if (RecordBatch.isBatch(chunk)) return chunk.length
+  return typeof chunk === 'string' || chunk instanceof Uint8Array ? 0 : 1
+}
+
+// Every branch of the pipeline, to its end
+function drain (branches) {
+  return Promise.all(branches.map(({ writeStream }) => new Promise((resolve, reject) => {
+    writeStream.on('data', () => {})
+    writeStream.on('end', resolve)
+    writeStream.on('error', reject)
+  })))
+}
+
+// Arrow and Parquet datasets are converted from the CSV one, once per size
+async function columnarDataset (format, size) {
+  const file = path.join(DIRECTORY, `${format}-${size}.${format}`)
+  if (!fs.existsSync(file)) {
+    const { branches } = await build([
+      stage('FileLoader', { 'File': await dataset('csv', size) }),
+      stage('CSVParser', FAST_BATCHES),
+      stage('FileOutput', { 'Format': format === 'arrow' ? 'Arrow' : 'Parquet', 'File name': file + '.tmp' })
+    ])
+    await drain(branches)
+    fs.renameSync(file + '.tmp', file)
+  }
+  return file
+}
+
+async function runCase (c, size) {
+  const columnar = c.format === 'arrow' || c.format === 'parquet'
+  const file = columnar ? await columnarDataset(c.format, size) : await dataset(c.format, size, c.gzip)
+  const blob = await openBlob(file)
+  // Throughput of compressed inputs is over the text they hold
+  const bytes = c.gzip ? fs.statSync(await dataset(c.format, size)).size : blob.size
+  // Written next to the datasets and removed after the run
+  const output = c.output ? path.join(DIRECTORY, `output-${process.pid}.${EXTENSIONS[c.output]}`) : null
+  const stages = [stage('FileLoader', { 'File': blob })]
+    .concat(typeof c.stages === 'function' ? c.stages() : c.stages)
+    .concat(output ? [stage('FileOutput', { 'Format': c.output, 'File name': output })] : [])
+  if (global.gc) global.gc()
+  let peak = process.memoryUsage().heapUsed
+  const timer = setInterval(() => { peak = Math.max(peak, process.memoryUsage().heapUsed) }, HEAP_INTERVAL)
+  const start = performance.now()
+  let rows = 0
+  try {
+    const { branches } = await build(stages)
+    branches.forEach(({ writeStream }) => writeStream.on('data', chunk => { rows += countRows(chunk) }))
+    await drain(branches)
+  } finally {
+    clearInterval(timer)
+    if (output && fs.existsSync(output)) fs.unlinkSync(output)
+  }
+  const seconds = (performance.now() - start) / 1000
+  peak = Math.max(peak, process.memoryUsage().heapUsed)
+  return {
+    name: c.name,
+    bytes,
+    rows,
+    seconds,
+    mbPerSecond: bytes / 1048576 / seconds,
+    rowsPerSecond: rows / seconds,
+    peakHeapMB: peak / 1048576
+  }
+}
+
+function parseArgs (argv) {
+  const args = { sizes: '10MB', filter: '', json: null }
+  for (let i = 0; i < argv.length; i++) {
+    const key = argv[i].replace(/^--/, '')
+    if (key in args) args[key] = argv[++i]
+  }
+  return args
+}
+
+function print (r) {
+  const cells = [
+    r.name.padEnd(30),
+    `${(r.bytes / 1048576).toFixed(0)} MB`.padStart(9),
+    `${r.seconds.toFixed(2)} s`.padStart(10),
+    `${r.mbPerSecond.toFixed(1)} MB/s`.padStart(12),
+    (r.rows ? `${Math.round(r.rowsPerSecond).toLocaleString()} rows/s` : '-').padStart(18),
+    `${r.peakHeapMB.toFixed(0)} MB heap`.padStart(14)
+  ]
+  console.log(cells.join(' '))
+}
+
+async function main () {
+  const args = parseArgs(process.argv.slice(2))
+  if (!global.gc) console.warn('Run with --expose-gc for comparable heap numbers')
+  const results = []
+  for (const size of args.sizes.split(',').map(parseSize)) {
+    for (const c of CASES.filter(c => c.name.toLowerCase().includes(args.filter.toLowerCase()))) {
+      const result = await runCase(c, size)
+      print(result)
+      results.push(result)
+    }
+  }
+  if (args.json) {
+    fs.writeFileSync(args.json, JSON.stringify({ node: process.version, date: new Date().toISOString(), results }, null, 2))
+  }
+}
+
+main().catch(err => {
+  console.error(err)
+  process.exit(1)
+})
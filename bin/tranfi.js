@@ -0,0 +1,95 @@
+#!/usr/bin/env node
+// Runs a saved pipeline headless:
+//   tranfi pipeline.json [--input data.csv] [--quiet]
+// FileLoader reads --input, or the file name saved with the pipeline, with native fs streams;
+// Join lookup files are resolved next to the pipeline.
+// TextOutput and TableOutput print to stdout, FileOutput writes its file name, a pipeline
+// without an output prints its records as JSON lines (the last branch's, when it has branches).
+const fs = require('fs')
+const path = require('path')
+const { deserializeStages, build } = require('../src/pipeline')
+const { RecordBatch } = require('../src/batch')
+const { ProgressCounter } = require('../src/progress')
+
+const PROGRESS_INTERVAL = 200 // ms
+
+function parseArgs (argv) {
+  const args = { pipeline: null, input: null, quiet: false }
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i] === '--input') args.input = argv[++i]
+    else if (argv[i] === '--quiet') args.quiet = true
+    else args.pipeline = argv[i]
+  }
+  return args
+}
+
+function printProgress (p) {
+  const parts = []
+  if (p.total) parts.push(`${(p.loaded / p.total * 100).toFixed(1)}%`)
+  parts.push(`${p.rows} rows`, `${Math.round(p.rowsPerSecond)} rows/s`)
+  if (p.eta !== null && p.loaded < p.total) parts.push(`ETA ${(p.eta / 1000).toFixed(1)} s`)
+  process.stderr.write(`\r${parts.join(' · ')}\x1b[K`)
+}
+
+function usage () {
+  console.error('Usage: tranfi <pipeline.json> [--input <file>] [--quiet]')
+  process.exit(2)
+}
+
+async function main () {
+  const args = parseArgs(process.argv.slice(2))
+  if (!args.pipeline) usage()
+  const json = JSON.parse(fs.readFileSync(args.pipeline, 'utf8'))
+  const stages = deserializeStages(json)
+  const transforms = require('../src/transforms')
+
+  for (const stage of stages) {
+    if (stage.name === 'FileLoader') {
+      const file = args.input || (stage.params['File'] && path.resolve(path.dirname(args.pipeline), stage.params['File']))
+      if (!file) throw new Error('FileLoader needs --input')
+      // The sampler seeks in the file, which needs a Blob
+      stage.params['File'] = stage.params['Sample'] && fs.openAsBlob ? await fs.openAsBlob(file) : file
+    }
+    if (stage.name === 'Join' && stage.params['Lookup file']) {
+      stage.params['Lookup file'] = path.resolve(path.dirname(args.pipeline), stage.params['Lookup file'])
+    }
+    // Parallel parsers run in Web Workers
+    if (stage.params['Parallel']) {
+      console.error(`${stage.name}: parallel mode needs a browser, parsing on one thread`)
+      stage.params['Parallel'] = false
+    }
+  }
+  if (!stages.some(stage => transforms[stage.name].type === 'output')) {
+    stages.push({ id: stages.length, name: 'TextOutput', params: {} })
+  }
+
+  // Sampled on a timer, the pipeline only updates counters
+  const progress = new ProgressCounter()
+  const { readStream, branches, destroy } = await build(stages, {
+    onProgress: args.quiet ? null : (loaded, total) => progress.update(loaded, total),
+    onRows: args.quiet ? null : (n) => progress.addRows(n)
+  })
+  // The reader of stdout is done (tranfi ... | head), so is the run
+  process.stdout.on('error', err => {
+    if (err.code !== 'EPIPE') return
+    destroy()
+    process.exit(0)
+  })
+  const timer = args.quiet ? null : setInterval(() => printProgress(progress.snapshot()), PROGRESS_INTERVAL)
+  await Promise.all(branches.map(({ writeStream }) => new Promise((resolve, reject) => {
+    readStream.on('error', reject)
+    writeStream.on('end', resolve)
+    writeStream.on('error', reject)
+    writeStream.on('data', RecordBatch.release)
+  })))
+  if (timer) {
+    clearInterval(timer)
+    printProgress(progress.snapshot())
+    process.stderr.write('\n')
+  }
+}
+
+main().catch(err => {
+  console.error(err.message)
+  process.exit(1)
+})
@@ -0,0 +1,230 @@
+// Hash aggregation with bounded memory. Group states live in a Map keyed on the joined group values;
+// when the table outgrows its budget all states are spilled into hash partitions,
+// and at the end every partition is merged and emitted on its own.
+const { hash32, HyperLogLog, TDigest } = require('./sketches')
+const { createSpillFile } = require('./spill')
+
+const PARTITIONS = 16
+const KEY_SEPARATOR = '\u0001'
+const GROUP_SIZE = 96 // rough bytes of a group entry besides its keys and states
+const STATE_SIZES = { distinct: 4096, quantile: 2048 } // sketches, other states are a number or two
+
+const isMissing = (v) => v === null || typeof v === 'undefined' || v === ''
+
+const AGGREGATES = {
+  count: {
+    init: () => 0,
+    add: (s, v, field) => !field || !isMissing(v) ? s + 1 : s,
+    merge: (a, b) => a + b,
+    result: (s) => s
+  },
+  sum: {
+    init: () => 0,
+    add: (s, v) => typeof v === 'number' ? s + v : s,
+    merge: (a, b) => a + b,
+    result: (s) => s
+  },
+  min: {
+    init: () => null,
+    add: (s, v) => !isMissing(v) && (s === null || v < s) ? v : s,
+    merge: (a, b) => b !== null && (a === null || b < a) ? b : a,
+    result: (s) => s
+  },
+  max: {
+    init: () => null,
+    add: (s, v) => !isMissing(v) && (s === null || v > s) ? v : s,
+    merge: (a, b) => b !== null && (a === null || b > a) ? b : a,
+    result: (s) => s
+  },
+  mean: {
+    init: () => [0, 0],
+    add: (s, v) => {
+      if (typeof v === 'number') {
+        s[0] += v
+        s[1] += 1
+      }
+      return s
+    },
+    merge: (a, b) => [a[0] + b[0], a[1] + b[1]],
+    result: (s) => s[1] ? s[0] / s[1] : null
+  },
+  // Approximate distinct count
+  distinct: {
+    init: () => new HyperLogLog(),
+    add: (s, v) => {
+      if (!isMissing(v)) s.add(v)
+      return s
+    },
+    merge: (a, b) => a.merge(b),
+    result: (s) => s.count(),
+    save: (s) => s.toJSON(),
+    load: (json) => HyperLogLog.fromJSON(json)
+  },
+  // Approximate quantile, quantile(field, 0.95)
+  quantile: {
+    init: () => new TDigest(),
+    add: (s, v) => {
+      s.add(v)
+      return s
+    },
+    merge: (a, b) => a.merge(b),
+    result: (s, arg) => s.quantile(arg),
+    save: (s) => s.toJSON(),
+    load: (json) => TDigest.fromJSON(json)
+  }
+}
+
+// "count, sum(amount), quantile(latency, 0.95)" to aggregate specs
+function parseAggregates (spec) {
+  const items = (spec || 'count').match(/[^,(]+(\([^)]*\))?/g) || []
+  return items.map(item => item.trim()).filter(item => item.length).map(item => {
+    const m = /^(\w+)\s*(?:\(\s*([^,)]*?)\s*(?:,\s*([^)]*?)\s*)?\))?$/.exec(item)
+    if (!m || !AGGREGATES[m[1]]) {
+      throw new Error(`Unknown aggregate: ${item}`)
+    }
+    const fn = m[1]
+    const field = m[2] || null
+    const arg = fn === 'quantile' ? (m[3] ? parseFloat(m[3]) : 0.5) : null
+    const name = fn === 'quantile'
+      ? `p${Math.round(arg * 1000) / 10}_${field}`
+      : field ? `${fn}_${field}` : fn
+    return { fn, field, arg, name, impl: AGGREGATES[fn] }
+  })
+}
+
+class HashAggregation {
+  constructor (keys, aggregates, maxGroups) {
+    this.keys = keys
+    this.aggregates = aggregates
+    this.maxGroups = maxGroups || 100000
+    this.groups = new Map()
+    this.partitions = null
+    this.keyValues = new Array(keys.length)
+    this.groupSize = GROUP_SIZE + keys.length * 32 +
+      aggregates.reduce((size, a) => size + (STATE_SIZES[a.fn] || 16), 0)
+  }
+
+  get overBudget () {
+    return this.groups.size > this.maxGroups
+  }
+
+  // Estimated bytes of the groups in memory
+  get size () {
+    return this.groups.size * this.groupSize
+  }
+
+  // get(name) returns the current row's value of a field
+  add (get) {
+    const keys = this.keys
+    let key = ''
+    for (let j = 0; j < keys.length; j++) {
+      const v = get(keys[j])
+      this.keyValues[j] = v
+      key = j ? key + KEY_SEPARATOR + v : String(v)
+    }
+    let entry = this.groups.get(key)
+    if (typeof entry === 'undefined') {
+      entry = { keys: this.keyValues.slice(), states: this.aggregates.map(a => a.impl.init()) }
+      this.groups.set(key, entry)
+    }
+    const aggregates = this.aggregates
+    const states = entry.states
+    for (let j = 0; j < aggregates.length; j++) {
+      const a = aggregates[j]
+      states[j] = a.impl.add(states[j], a.field ? get(a.field) : null, a.field)
+    }
+  }
+
+  addRecord (record) {
+    this.add(name => record[name])
+  }
+
+  addBatch (batch) {
+    const columns = Object.create(null)
+    batch.columns.forEach(c => { columns[c.name] = c })
+    let row = 0
+    const get = (name) => columns[name] ? columns[name].get(row) : null
+    for (row = 0; row < batch.length; row++) {
+      this.add(get)
+    }
+  }
+
+  async spill () {
+    if (!this.partitions) {
+      this.partitions = []
+      for (let i = 0; i < PARTITIONS; i++) {
+        this.partitions.push(await createSpillFile('groupby'))
+      }
+    }
+    const lines = this.partitions.map(() => [])
+    this.groups.forEach((entry, key) => {
+      const saved = entry.states.map((s, j) => {
+        const impl = this.aggregates[j].impl
+        return impl.save ? impl.save(s) : s
+      })
+      lines[hash32(key) % PARTITIONS].push(JSON.stringify([entry.keys, saved]))
+    })
+    this.groups.clear()
+    for (let i = 0; i < PARTITIONS; i++) {
+      if (lines[i].length) {
+        await this.partitions[i].append(lines[i])
+      }
+    }
+  }
+
+  row (entry) {
+    const record = {}
+    this.keys.forEach((k, j) => { record[k] = entry.keys[j] })
+    this.aggregates.forEach((a, j) => { record[a.name] = a.impl.result(entry.states[j], a.arg) })
+    return record
+  }
+
+  // Yields arrays of result rows, one per partition when spilled
+  async * results () {
+    if (!this.partitions) {
+      yield Array.from(this.groups.values(), entry => this.row(entry))
+      this.groups.clear()
+      return
+    }
+    await this.spill()
+    // Merged partitions leave the list, remove() drops the others
+    while (this.partitions.length) {
+      const partition = this.partitions.shift()
+      await partition.close()
+      const merged = new Map()
+      for await (const line of partition.lines()) {
+        const [keys, saved] = JSON.parse(line)
+        const key = keys.join(KEY_SEPARATOR)
+        const states = saved.map((s, j) => {
+          const impl = this.aggregates[j].impl
+          return impl.load ? impl.load(s) : s
+        })
+        const entry = merged.get(key)
+        if (entry) {
+          entry.states = entry.states.map((s, j) => this.aggregates[j].impl.merge(s, states[j]))
+        } else {
+          merged.set(key, { keys, states })
+        }
+      }
+      await partition.remove()
+      yield Array.from(merged.values(), entry => this.row(entry))
+    }
+    this.partitions = null
+  }
+
+  // Drops the groups and the spilled partitions, also for aggregations stopped before their results
+  async remove () {
+    const partitions = this.partitions || []
+    this.partitions = null
+    this.groups.clear()
+    for (const partition of partitions) {
+      await partition.remove()
+    }
+  }
+}
+
+module.exports = {
+  AGGREGATES,
+  parseAggregates,
+  HashAggregation
+}
@@ -1,91 +1,256 @@
 const through2 = require('through2')
 const transforms = require('./transforms')
+const { saveAs } = require('file-saver')
+const { defaultValue, serializePipeline, getParams, getStages, splitOutputs, build } = require('./pipeline')
+const { RecordBatch } = require('./batch')
+const { snapshots } = require('./metrics')
+const { StageCache } = require('./cache')
+const { ProgressCounter } = require('./progress')
+const { clearSpills } = require('./spill')
+const PipelineWorker = require('./pipeline.worker.js').default
 
-async function run (pipeline, isBatch) {
-  let readStream
-  let writeStream
+const PROGRESS_TEXT_INTERVAL = 250 // ms between updates of the progress line
 
-  for (const transform of pipeline) {
-    // Convert inputs to params object
-    const params = {}
-    transform.inputs.forEach(i => {
-      params[i.name] = i.type === 'file' ? i.file : i.value
+const requestFrame = typeof requestAnimationFrame !== 'undefined'
+  ? requestAnimationFrame
+  : (cb) => setTimeout(cb, 16)
+
+function hideProgress () {
+  let progressBar = document.getElementById('progress')
+  progressBar.style.display = 'none'
+}
+
+// Draws the progress bar from peek() on animation frames where the loaded bytes changed, and passes
+// a snapshot from read() to onProgress a few times a second, until stop() is called.
+// peek() only needs loaded and total, read() samples the rates, over the longer interval.
+function sampleProgress (peek, read, onProgress) {
+  const progressBar = document.getElementById('progress')
+  let running = true
+  let loaded = -1
+  let total = -1
+  let reported = -Infinity
+  const frame = (time) => {
+    if (!running) return
+    const counts = peek()
+    if (counts && counts.total && (counts.loaded !== loaded || counts.total !== total)) {
+      progressBar.style.display = 'initial'
+      progressBar.style.width = ((counts.loaded / counts.total) * 100).toFixed(1) + '%'
+      loaded = counts.loaded
+      total = counts.total
+    }
+    if (counts && time - reported >= PROGRESS_TEXT_INTERVAL) {
+      onProgress(read())
+      reported = time
+    }
+    requestFrame(frame)
+  }
+  requestFrame(frame)
+  return () => {
+    running = false
+    const progress = read()
+    if (progress) onProgress(progress)
+    hideProgress()
+  }
+}
+
+const METRICS_INTERVAL = 250 // ms
+
+// Stage results of main-thread runs, the worker keeps its own
+const cache = new StageCache()
+
+// Reports stage metrics of a main-thread chain, and memory usage when given,
+// until stop() is called, and once more then
+function reportMetrics (metrics, hooks, memory) {
+  const report = () => {
+    hooks.onMetrics(snapshots(metrics))
+    if (memory) hooks.onMemory(memory.usage())
+  }
+  const timer = setInterval(report, METRICS_INTERVAL)
+  return () => {
+    clearInterval(timer)
+    report()
+  }
+}
+
+// Resolves once every branch has ended
+function allEnded (streams) {
+  return Promise.all(streams.map(stream => new Promise(resolve => stream.on('end', resolve))))
+}
+
+// limit: records to pass to the outputs of each branch before pausing, 0 to run through
+async function run (stages, limit, hooks) {
+  const progress = new ProgressCounter()
+  await clearSpills()
+  const {branches, metrics, memory, destroy} = await build(stages, {
+    onProgress: (loaded, total) => progress.update(loaded, total),
+    onRows: (n) => progress.addRows(n),
+    onMetadata: hooks.onMetadata,
+    metrics: true,
+    cache: hooks.cache ? cache : null,
+    memoryLimit: hooks.memoryLimit,
+    limit
+  })
+  const stopMetrics = reportMetrics(metrics, hooks, memory)
+  // The counter's own fields are enough for the bar, snapshots advance the rates
+  const stopProgress = sampleProgress(() => progress, () => progress.snapshot(), hooks.onProgress)
+
+  let done = false
+  const finish = () => {
+    if (done) return
+    done = true
+    stopMetrics()
+    stopProgress()
+    hooks.onEnd()
+  }
+  allEnded(branches.map(b => b.writeStream)).then(finish)
+  // Errors of every stage are forwarded to the end of its branch
+  branches.forEach(b => b.writeStream.on('error', err => {
+    console.error(err.message)
+    destroy()
+    finish()
+  }))
+  // Nothing reads past the outputs, so pooled batches are handed back here
+  branches.forEach(b => b.writeStream.on('data', RecordBatch.release))
+
+  return {
+    more: (rows) => branches.forEach(b => b.gate && b.gate.more(rows)),
+    cancel: () => {
+      stopMetrics()
+      stopProgress()
+      destroy()
+    }
+  }
+}
+
+let worker = null
+let workerRunId = 0
+
+// Loaders, parsers and transforms run in the worker,
+// DOM-bound outputs of every branch are fed on the main thread from posted chunks
+async function runInWorker (stages, limit, hooks) {
+  const split = splitOutputs(stages)
+  if (!split || !split.worker.length) {
+    return run(stages, limit, hooks)
+  }
+
+  const sources = []
+  const ends = []
+  const metrics = []
+  for (const outputStages of split.outputs) {
+    const source = through2.obj()
+    const outputs = await build(outputStages, {onMetadata: hooks.onMetadata, metrics: true})
+    metrics.push(...outputs.metrics)
+    if (typeof outputs.readStream !== 'undefined') {
+      source.pipe(outputs.readStream)
+      outputs.writeStream.resume()
+      ends.push(outputs.writeStream)
+    } else {
+      source.resume()
+      ends.push(source)
+    }
+    sources.push(source)
+  }
+  const ended = allEnded(ends)
+  // Memory is reported by the worker, where the stages holding state run
+  const stopMetrics = reportMetrics(metrics, hooks, null)
+  // The worker posts snapshots on its own timer, frames draw the latest one
+  let progress = null
+  const stopProgress = sampleProgress(() => progress, () => progress, hooks.onProgress)
+  // Done once the outputs have written what the worker sent
+  const finish = () => {
+    sources.forEach(source => source.end())
+    ended.then(() => {
+      stopMetrics()
+      stopProgress()
+      hooks.onEnd()
     })
-    // Init stream
-    let nextStream = await transforms[transform.name].initStream(params)
-    if (typeof readStream === 'undefined') {
-      readStream = writeStream = nextStream
-      if ('File' in params) {
-        let size = params['File'].size
-        let progressBytes = 0
-        let progressBar = document.getElementById('progress')
-        progressBar.style.display = 'initial'
-        const progressStream = through2(function (chunk, enc, callback) {
-          progressBytes += chunk.length
-          let progressPercents = ((progressBytes / size) * 100).toFixed(1)
-          progressBar.style.width = progressPercents + '%'
-          this.push(chunk)
-          callback()
-        })
-        writeStream = writeStream.pipe(progressStream)
+  }
+
+  if (!worker) {
+    worker = new PipelineWorker()
+  }
+  const runId = ++workerRunId
+  worker.onmessage = (e) => {
+    const message = e.data
+    if (message.runId !== runId) return
+    switch (message.type) {
+      case 'progress':
+        progress = message.progress
+        break
+      case 'metadata':
+        hooks.onMetadata(message.id, message.metadata)
+        break
+      case 'metrics':
+        hooks.onMetrics(message.stages)
+        hooks.onMemory(message.memory)
+        break
+      case 'data': {
+        // The worker holds the branch back until its outputs have taken these chunks
+        const source = sources[message.branch]
+        const ack = () => worker.postMessage({ type: 'ack', runId, branch: message.branch })
+        let ok = true
+        message.chunks.forEach(chunk => { ok = source.write(RecordBatch.revive(chunk)) })
+        if (ok) {
+          ack()
+        } else {
+          source.once('drain', ack)
+        }
+        break
       }
-    } else {
-      writeStream = writeStream.pipe(nextStream) //, {end: false})
+      case 'end':
+        console.log('Processed', message.rows, 'rows in worker')
+        finish()
+        break
+      case 'error':
+        console.error(message.message)
+        finish()
+        break
     }
   }
+  worker.postMessage({ type: 'run', runId, stages: split.worker, limit, cache: hooks.cache, memoryLimit: hooks.memoryLimit })
 
-  writeStream.on('data', (piece) => {
-    if (isBatch) {
-      console.log('Pausing stream')
-      readStream.pause()
+  return {
+    more: (rows) => worker.postMessage({ type: 'more', rows }),
+    cancel: () => {
+      stopMetrics()
+      stopProgress()
+      worker.postMessage({ type: 'cancel' })
     }
-  })
+  }
+}
 
-  return {readStream, writeStream}
+function formatBytes (bytes) {
+  const units = ['B', 'KB', 'MB', 'GB']
+  let i = 0
+  while (bytes >= 1024 && i < units.length - 1) {
+    bytes /= 1024
+    i += 1
+  }
+  return `${i ? bytes.toFixed(1) : bytes} ${units[i]}`
+}
+
+function formatTime (ms) {
+  return ms < 1000 ? `${Math.round(ms)} ms` : `${(ms / 1000).toFixed(1)} s`
+}
+
+function formatCount (n) {
+  return n >= 1e6 ? `${(n / 1e6).toFixed(1)}M` : n >= 1e3 ? `${(n / 1e3).toFixed(1)}k` : `${Math.round(n)}`
 }
 
 function resetInputs (inputs) {
   inputs.forEach(input => {
-    if (input.default) {
-      input.value = input.default
-    } else {
-      switch (input.type) {
-        case 'int':
-        case 'float':
-        case 'number':
-          input.value = 0
-          break
-        case 'string':
-        case 'text':
-          input.value = ''
-          break
-        case 'color':
-          input.value = '#000000'
-          break
-        case 'categorical':
-        case 'select':
-          input.value = input.options ? input.options[0] : ''
-          break
-        case 'bool':
-        case 'checkbox':
-          input.value = false
-          break
-        case 'file':
-          input.file = null
-          input.value = ''
-          break
-        case 'group':
-          resetInputs(input.elements)
-          break
-        default:
-          input.value = ''
-      }
+    if (input.type === 'group') {
+      resetInputs(input.elements)
+      return
+    }
+    if (input.type === 'file') {
+      input.file = null
     }
+    input.value = defaultValue(input)
   })
 }
 
-let readStream = null
-let writeStream = null
+let execution = null
 export default {
   components: {
 //    draggable,
@@ -100,6 +265,13 @@ export default {
       showResults: false,
       modalAddTransforms: false,
       counter: 0,
+      worker: true,
+      // Off by default: cached runs are planned without filter and field pushdown into parsers
+      cache: false,
+      memoryLimit: 0,
+      memory: null,
+      progress: null,
+      batchSize: 100,
       transforms: transforms,
       pipeline: []
     }
@@ -115,6 +287,60 @@ export default {
       this.counter += 1
       this.pipeline.splice(i + 1, 0, newTransform)
     },
+    // Schema and other facts stages report while running
+    describeMetadata (metadata) {
+      const parts = metadata.schema ? [metadata.schema.map(c => `${c.name}: ${c.type}`).join(', ')] : []
+      if (metadata.rowGroups) parts.push(`${metadata.rowGroups.skipped} of ${metadata.rowGroups.total} row groups skipped`)
+      return parts.join(' · ')
+    },
+    describeMetrics (m) {
+      const parts = []
+      if (m.bytesIn || m.bytesOut) parts.push(`${formatBytes(m.bytesIn)} → ${formatBytes(m.bytesOut)}`)
+      if (m.recordsIn || m.recordsOut) parts.push(`${m.recordsIn.toLocaleString()} → ${m.recordsOut.toLocaleString()} rows`)
+      parts.push(`busy ${formatTime(m.busy)}`, `blocked ${formatTime(m.blocked)}`)
+      return parts.join(' · ')
+    },
+    describeProgress (p) {
+      const parts = []
+      if (p.total) parts.push(`${(p.loaded / p.total * 100).toFixed(1)}%`)
+      parts.push(`${formatCount(p.rows)} rows`, `${formatCount(p.rowsPerSecond)} rows/s`, `${formatBytes(Math.round(p.bytesPerSecond))}/s`)
+      if (p.eta !== null && p.loaded < p.total) parts.push(`ETA ${formatTime(p.eta)}`)
+      else parts.push(formatTime(p.elapsed))
+      return parts.join(' · ')
+    },
+    describeMemory (m) {
+      const parts = []
+      if (m.heap) parts.push(`heap ${formatBytes(m.heap)}`)
+      parts.push(`stages ${formatBytes(m.tracked)} of ${formatBytes(m.limit)}`)
+      m.stages.forEach(s => parts.push(`${s.name} ${formatBytes(s.size)}`))
+      return parts.join(' · ')
+    },
+    outputType (t) {
+      const Transform = transforms[t.name]
+      return Transform.getOutputType ? Transform.getOutputType(getParams(t)) : t.outputType
+    },
+    savePipeline () {
+      const json = JSON.stringify(serializePipeline(this.pipeline, this.title), null, 2)
+      saveAs(new Blob([json], { type: 'application/json' }), `${this.title || 'pipeline'}.json`)
+    },
+    // Files are not part of saved pipelines and have to be picked again
+    openPipeline (e) {
+      const file = e.target.files[0]
+      if (!file) return
+      file.text().then(text => {
+        const json = JSON.parse(text)
+        this.title = json.title || ''
+        this.pipeline = json.transforms.map(saved => {
+          const t = new transforms[saved.name](this.counter++)
+          resetInputs(t.inputs)
+          t.inputs.forEach(input => {
+            if (input.type !== 'file' && input.name in saved.inputs) input.value = saved.inputs[input.name]
+          })
+          return t
+        })
+      }).catch(err => console.error('Could not open pipeline:', err.message))
+      e.target.value = ''
+    },
     resetTransform (t) {
       resetInputs(t.inputs)
     },
@@ -149,19 +375,54 @@ export default {
       }
     },
     run (isBatch) {
-      run(this.pipeline, isBatch).then(streams => {
-        this.loadedAllData = false
-        readStream = streams.readStream
-        readStream.on('end', function () {
+      if (execution) {
+        execution.cancel()
+      }
+      const stages = getStages(this.pipeline)
+      this.pipeline.forEach(t => {
+        t.metadata = null
+        t.metrics = null
+      })
+      this.memory = null
+      this.progress = null
+      const hooks = {
+        onProgress: (progress) => {
+          this.progress = progress
+        },
+        cache: this.cache,
+        // MB in the UI, 0 for the default
+        memoryLimit: this.memoryLimit * 1024 * 1024,
+        onMemory: (memory) => {
+          this.memory = memory
+        },
+        onMetrics: (list) => {
+          list.forEach(({ id, metrics }) => {
+            const t = this.pipeline.find(el => el.id === id)
+            if (t) t.metrics = metrics
+          })
+        },
+        onMetadata: (id, metadata) => {
+          const t = this.pipeline.find(el => el.id === id)
+          if (t) t.metadata = metadata
+        },
+        onEnd: () => {
           this.loadedAllData = true
           console.log('End of stream')
-          let progressBar = document.getElementById('progress')
-          progressBar.style.display = 'none'
-        })
+          hideProgress()
+        }
+      }
+      this.loadedAllData = false
+      const runner = this.worker ? runInWorker : run
+      runner(stages, isBatch ? this.batchSize : 0, hooks).then(e => {
+        execution = e
+      }).catch(err => {
+        console.error('Could not run pipeline:', err.message)
+        hooks.onEnd()
       })
     },
     runMore () {
-      readStream.resume()
+      // No run yet, or still being built
+      if (execution) execution.more(this.batchSize)
     }
   },
   watch: {
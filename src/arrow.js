@@ -0,0 +1,752 @@
+// Arrow IPC, file and stream formats, as record batches. Flat columns only: integers, floats, booleans,
+// dates and timestamps (as ms) become numeric columns, Utf8 and dictionary-encoded text become text
+// columns, dictionary indices mapping straight onto batch codes. Only the buffers of the columns
+// read are fetched. Files are written with Float64 and Utf8 columns.
+const { NUMBER, STRING, Column, RecordBatch } = require('./batch')
+const { concatBytes, typedView, split, BatchPacker, schemaOf, conform } = require('./columnar')
+
+const MAGIC = [0x41, 0x52, 0x52, 0x4f, 0x57, 0x31] // ARROW1
+const SCHEMA_SAMPLE_ROWS = 65536 // rows held before the schema is written, column types are decided over them
+const CONTINUATION = -1
+const V5 = 4
+const TWO_32 = 4294967296
+
+// Message header union
+const SCHEMA = 1
+const DICTIONARY_BATCH = 2
+const RECORD_BATCH = 3
+
+// Type union
+const NULL = 1
+const INT = 2
+const FLOATING_POINT = 3
+const BINARY = 4
+const UTF8 = 5
+const BOOL = 6
+const DATE = 8
+const TIMESTAMP = 10
+const LARGE_UTF8 = 20
+const TYPE_NAMES = [
+  'NONE', 'Null', 'Int', 'FloatingPoint', 'Binary', 'Utf8', 'Bool', 'Decimal', 'Date', 'Time', 'Timestamp',
+  'Interval', 'List', 'Struct', 'Union', 'FixedSizeBinary', 'FixedSizeList', 'Map', 'Duration',
+  'LargeBinary', 'LargeUtf8', 'LargeList'
+]
+const NESTED = new Set([12, 13, 14, 16, 17, 21])
+const VARIABLE = new Set([BINARY, UTF8, 19, LARGE_UTF8])
+const TIMESTAMP_SCALE = [1000, 1, 1e-3, 1e-6] // to ms, by unit
+
+const decoder = new TextDecoder()
+const encoder = new TextEncoder()
+
+const align8 = (n) => (n + 7) & ~7
+
+function readInt64 (view, pos) {
+  return view.getUint32(pos, true) + view.getInt32(pos + 4, true) * TWO_32
+}
+
+function isMagic (bytes, pos) {
+  return MAGIC.every((b, i) => bytes[pos + i] === b)
+}
+
+// Flatbuffer table: fields are located through the vtable, absent ones take their default
+class Table {
+  constructor (view, pos) {
+    this.view = view
+    this.pos = pos
+    this.vtable = pos - view.getInt32(pos, true)
+    this.vsize = view.getUint16(this.vtable, true)
+  }
+
+  static root (bytes) {
+    const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+    return new Table(view, view.getUint32(0, true))
+  }
+
+  offset (field) {
+    const o = 4 + 2 * field
+    return o < this.vsize ? this.view.getUint16(this.vtable + o, true) : 0
+  }
+
+  uint8 (field, d = 0) {
+    const o = this.offset(field)
+    return o ? this.view.getUint8(this.pos + o) : d
+  }
+
+  bool (field, d = false) {
+    return !!this.uint8(field, +d)
+  }
+
+  int16 (field, d = 0) {
+    const o = this.offset(field)
+    return o ? this.view.getInt16(this.pos + o, true) : d
+  }
+
+  int32 (field, d = 0) {
+    const o = this.offset(field)
+    return o ? this.view.getInt32(this.pos + o, true) : d
+  }
+
+  int64 (field, d = 0) {
+    const o = this.offset(field)
+    return o ? readInt64(this.view, this.pos + o) : d
+  }
+
+  // Position an offset field points to
+  target (field) {
+    const o = this.offset(field)
+    if (!o) return 0
+    const p = this.pos + o
+    return p + this.view.getUint32(p, true)
+  }
+
+  table (field) {
+    const p = this.target(field)
+    return p ? new Table(this.view, p) : null
+  }
+
+  string (field) {
+    const p = this.target(field)
+    if (!p) return null
+    const length = this.view.getUint32(p, true)
+    return decoder.decode(new Uint8Array(this.view.buffer, this.view.byteOffset + p + 4, length))
+  }
+
+  // {start, length} of a vector, elements start right after its length
+  vector (field) {
+    const p = this.target(field)
+    return p ? { start: p + 4, length: this.view.getUint32(p, true) } : { start: 0, length: 0 }
+  }
+
+  tables (field) {
+    const { start, length } = this.vector(field)
+    const tables = []
+    for (let i = 0; i < length; i++) {
+      const p = start + 4 * i
+      tables.push(new Table(this.view, p + this.view.getUint32(p, true)))
+    }
+    return tables
+  }
+}
+
+// Field values for the builder, by kind
+const F = {
+  bool: (value) => ({ kind: 'bool', size: 1, value }),
+  uint8: (value) => ({ kind: 'uint8', size: 1, value }),
+  int16: (value) => ({ kind: 'int16', size: 2, value }),
+  int32: (value) => ({ kind: 'int32', size: 4, value }),
+  int64: (value) => ({ kind: 'int64', size: 8, value }),
+  string: (value) => ({ kind: 'string', size: 4, value }),
+  table: (value) => ({ kind: 'table', size: 4, value }),
+  tables: (value) => ({ kind: 'tables', size: 4, value }),
+  // Inline structs of `size` bytes, each written by write(builder, pos, item)
+  structs: (size, items, write) => ({ kind: 'structs', size: 4, value: { size, items, write } })
+}
+
+// Flatbuffers laid out front to back: every table is followed by what it refers to,
+// which keeps offsets positive without building in reverse. Tables are fields arrays by id.
+class Builder {
+  constructor () {
+    this.bytes = new Uint8Array(1024)
+    this.view = new DataView(this.bytes.buffer)
+    this.pos = 0
+  }
+
+  reserve (n) {
+    if (this.pos + n <= this.bytes.length) return
+    let size = this.bytes.length * 2
+    while (size < this.pos + n) size *= 2
+    const bytes = new Uint8Array(size)
+    bytes.set(this.bytes.subarray(0, this.pos))
+    this.bytes = bytes
+    this.view = new DataView(bytes.buffer)
+  }
+
+  pad (alignment) {
+    const n = (alignment - this.pos % alignment) % alignment
+    this.reserve(n)
+    this.pos += n
+  }
+
+  finish (fields) {
+    this.reserve(4)
+    this.pos = 4
+    const root = this.table(fields)
+    this.view.setUint32(0, root, true)
+    this.pad(8)
+    return this.bytes.slice(0, this.pos)
+  }
+
+  table (fields) {
+    const slots = []
+    fields.forEach((field, id) => { if (field) slots.push({ id, field }) })
+    slots.sort((a, b) => b.field.size - a.field.size)
+    let size = 4
+    slots.forEach(slot => {
+      size = Math.ceil(size / slot.field.size) * slot.field.size
+      slot.offset = size
+      size += slot.field.size
+    })
+
+    this.pad(2)
+    const vtable = this.pos
+    const vsize = 4 + 2 * fields.length
+    this.reserve(vsize)
+    this.view.setUint16(vtable, vsize, true)
+    this.view.setUint16(vtable + 2, size, true)
+    slots.forEach(slot => this.view.setUint16(vtable + 4 + 2 * slot.id, slot.offset, true))
+    this.pos += vsize
+
+    this.pad(8)
+    const table = this.pos
+    this.reserve(size)
+    this.pos += size
+    this.view.setInt32(table, table - vtable, true)
+    const children = []
+    slots.forEach(({ field, offset }) => {
+      const p = table + offset
+      switch (field.kind) {
+        case 'bool':
+        case 'uint8': return this.view.setUint8(p, +field.value)
+        case 'int16': return this.view.setInt16(p, field.value, true)
+        case 'int32': return this.view.setInt32(p, field.value, true)
+        case 'int64': return this.int64(p, field.value)
+        default: children.push({ field, p })
+      }
+    })
+    // Children may grow the buffer, the view is looked up after writing them
+    children.forEach(({ field, p }) => {
+      const at = this.child(field)
+      this.view.setUint32(p, at - p, true)
+    })
+    return table
+  }
+
+  int64 (p, value) {
+    this.view.setUint32(p, value % TWO_32, true)
+    this.view.setInt32(p + 4, Math.floor(value / TWO_32), true)
+  }
+
+  child (field) {
+    if (field.kind === 'table') return this.table(field.value)
+    if (field.kind === 'string') {
+      const bytes = encoder.encode(field.value)
+      this.pad(4)
+      const at = this.pos
+      this.reserve(4 + bytes.length + 1)
+      this.view.setUint32(at, bytes.length, true)
+      this.bytes.set(bytes, at + 4)
+      this.bytes[at + 4 + bytes.length] = 0
+      this.pos += 4 + bytes.length + 1
+      return at
+    }
+    if (field.kind === 'tables') {
+      this.pad(4)
+      const at = this.pos
+      const n = field.value.length
+      this.reserve(4 + 4 * n)
+      this.view.setUint32(at, n, true)
+      this.pos += 4 + 4 * n
+      field.value.forEach((fields, i) => {
+        const p = at + 4 + 4 * i
+        const table = this.table(fields)
+        this.view.setUint32(p, table - p, true)
+      })
+      return at
+    }
+    // Structs hold 8-byte values, the elements after the length are aligned to 8
+    const { size, items, write } = field.value
+    this.pad(8)
+    this.reserve(8 + size * items.length)
+    this.pos += 4
+    const at = this.pos
+    this.view.setUint32(at, items.length, true)
+    this.pos += 4
+    items.forEach((item, i) => write(this, at + 4 + size * i, item))
+    this.pos += size * items.length
+    return at
+  }
+}
+
+// Fields of a Schema table: {name, typeId, type, dictionary}, dictionary {id, indexWidth, signed} when encoded
+function readSchema (schema) {
+  return schema.tables(1).map(field => {
+    const typeId = field.uint8(2)
+    if (NESTED.has(typeId) || field.vector(5).length) {
+      throw new Error(`Nested Arrow column ${field.string(0)} is not supported`)
+    }
+    const encoding = field.table(4)
+    const indexType = encoding && encoding.table(1)
+    return {
+      name: field.string(0) || '',
+      typeId,
+      type: field.table(3),
+      dictionary: encoding ? {
+        id: encoding.int64(0),
+        indexWidth: indexType ? indexType.int32(0) : 32,
+        signed: indexType ? indexType.bool(1) : true
+      } : null
+    }
+  })
+}
+
+function bufferCount (field) {
+  if (field.typeId === NULL) return 0
+  return VARIABLE.has(field.typeId) && !field.dictionary ? 3 : 2
+}
+
+function columnType (field, dictionaries) {
+  if (field.dictionary) {
+    const dictionary = dictionaries.get(field.dictionary.id)
+    return dictionary ? dictionary.type : STRING
+  }
+  return VARIABLE.has(field.typeId) ? STRING : NUMBER
+}
+
+// Validity bitmap of a column, null when every value is set
+function validity (bytes, buffer, nullCount) {
+  return nullCount && buffer && buffer.length ? bytes.subarray(buffer.offset, buffer.offset + buffer.length) : null
+}
+
+const valid = (bits, i) => (bits[i >> 3] >> (i & 7)) & 1
+
+// Numeric values of a fixed-width field, converted to ms for dates and timestamps
+function readNumbers (field, bytes, buffers, length) {
+  const data = buffers[1]
+  const view = new DataView(bytes.buffer, bytes.byteOffset + data.offset, data.length)
+  const type = field.type
+  let values
+  switch (field.typeId) {
+    case NULL:
+      return new Float64Array(length).fill(NaN)
+    case INT: {
+      const width = type.int32(0)
+      const signed = type.bool(1)
+      if (width === 64) {
+        values = new Float64Array(length)
+        for (let i = 0; i < length; i++) {
+          const hi = signed ? view.getInt32(8 * i + 4, true) : view.getUint32(8 * i + 4, true)
+          values[i] = view.getUint32(8 * i, true) + hi * TWO_32
+        }
+        return values
+      }
+      const Type = { 8: signed ? Int8Array : Uint8Array, 16: signed ? Int16Array : Uint16Array, 32: signed ? Int32Array : Uint32Array }[width]
+      return Float64Array.from(typedView(Type, bytes, data.offset, data.offset + length * Type.BYTES_PER_ELEMENT))
+    }
+    case FLOATING_POINT: {
+      const precision = type.int16(0)
+      if (precision === 2) {
+        // Owned bytes, viewed in place without a copy
+        return typedView(Float64Array, bytes, data.offset, data.offset + length * 8)
+      }
+      if (precision === 1) {
+        return Float64Array.from(typedView(Float32Array, bytes, data.offset, data.offset + length * 4))
+      }
+      throw new Error(`Half-precision Arrow column ${field.name} is not supported`)
+    }
+    case BOOL:
+      values = new Float64Array(length)
+      for (let i = 0; i < length; i++) values[i] = (view.getUint8(i >> 3) >> (i & 7)) & 1
+      return values
+    case DATE:
+      values = new Float64Array(length)
+      if (type.int16(0, 1) === 0) {
+        for (let i = 0; i < length; i++) values[i] = view.getInt32(4 * i, true) * 86400000
+      } else {
+        for (let i = 0; i < length; i++) values[i] = readInt64(view, 8 * i)
+      }
+      return values
+    case TIMESTAMP: {
+      const scale = TIMESTAMP_SCALE[type.int16(0)]
+      values = new Float64Array(length)
+      for (let i = 0; i < length; i++) values[i] = readInt64(view, 8 * i) * scale
+      return values
+    }
+  }
+  throw new Error(`Arrow type ${TYPE_NAMES[field.typeId] || field.typeId} of column ${field.name} is not supported`)
+}
+
+// Text values of a Utf8 field as dictionary codes
+function readStrings (field, bytes, buffers, length, bits) {
+  if (field.typeId !== UTF8 && field.typeId !== LARGE_UTF8) {
+    throw new Error(`Arrow type ${TYPE_NAMES[field.typeId]} of column ${field.name} is not supported`)
+  }
+  const large = field.typeId === LARGE_UTF8
+  const view = new DataView(bytes.buffer, bytes.byteOffset + buffers[1].offset, buffers[1].length)
+  const data = bytes.subarray(buffers[2].offset, buffers[2].offset + buffers[2].length)
+  const offset = large ? (i) => readInt64(view, 8 * i) : (i) => view.getInt32(4 * i, true)
+  const codes = new Int32Array(length)
+  const dictionary = []
+  const index = new Map()
+  for (let i = 0; i < length; i++) {
+    if (bits && !valid(bits, i)) {
+      codes[i] = -1
+      continue
+    }
+    const s = decoder.decode(data.subarray(offset(i), offset(i + 1)))
+    let code = index.get(s)
+    if (typeof code === 'undefined') {
+      code = dictionary.length
+      dictionary.push(s)
+      index.set(s, code)
+    }
+    codes[i] = code
+  }
+  return { codes, dictionary }
+}
+
+// Dictionary indices looked up in the dictionary's decoded values
+function readEncoded (field, bytes, buffers, length, bits, dictionary) {
+  const { indexWidth, signed } = field.dictionary
+  const data = buffers[1]
+  const Type = { 8: signed ? Int8Array : Uint8Array, 16: signed ? Int16Array : Uint16Array, 32: signed ? Int32Array : Uint32Array }[indexWidth]
+  if (!Type) {
+    throw new Error(`Arrow dictionary indices of ${indexWidth} bits in column ${field.name} are not supported`)
+  }
+  const indices = typedView(Type, bytes, data.offset, data.offset + length * Type.BYTES_PER_ELEMENT)
+  if (dictionary.type === STRING) {
+    // Indices are the batch codes, null dictionary entries aside
+    const codes = Type === Int32Array && !bits && !dictionary.nulls ? indices : new Int32Array(length)
+    if (codes !== indices) {
+      for (let i = 0; i < length; i++) {
+        const code = bits && !valid(bits, i) ? -1 : indices[i]
+        codes[i] = code !== -1 && dictionary.values[code] === null ? -1 : code
+      }
+    }
+    return new Column(field.name, STRING, codes, dictionary.values)
+  }
+  const values = new Float64Array(length)
+  for (let i = 0; i < length; i++) {
+    const v = bits && !valid(bits, i) ? null : dictionary.values[indices[i]]
+    values[i] = v === null ? NaN : v
+  }
+  return new Column(field.name, NUMBER, values)
+}
+
+function readColumn (field, bytes, buffers, node, dictionaries) {
+  const bits = validity(bytes, buffers[0], node.nullCount)
+  if (field.dictionary) {
+    const dictionary = dictionaries.get(field.dictionary.id)
+    if (!dictionary) {
+      throw new Error(`Missing Arrow dictionary ${field.dictionary.id} of column ${field.name}`)
+    }
+    return readEncoded(field, bytes, buffers, node.length, bits, dictionary)
+  }
+  if (VARIABLE.has(field.typeId)) {
+    const { codes, dictionary } = readStrings(field, bytes, buffers, node.length, bits)
+    return new Column(field.name, STRING, codes, dictionary)
+  }
+  const values = readNumbers(field, bytes, buffers, node.length)
+  if (bits) {
+    for (let i = 0; i < node.length; i++) {
+      if (!valid(bits, i)) values[i] = NaN
+    }
+  }
+  return new Column(field.name, NUMBER, values)
+}
+
+// Encapsulated message at offset: {type, header, bodyStart, next}, null at the end of the stream
+async function readMessage (source, offset) {
+  if (offset + 8 > source.size) return null
+  const prefix = await source.read(offset, offset + 8)
+  const view = new DataView(prefix.buffer, prefix.byteOffset, 8)
+  let length = view.getInt32(0, true)
+  let start = offset + 4
+  // Before format 0.15 messages had no continuation marker
+  if (length === CONTINUATION) {
+    length = view.getInt32(4, true)
+    start = offset + 8
+  }
+  if (length === 0) return null
+  const message = Table.root(await source.read(start, start + length))
+  const bodyStart = start + length
+  return {
+    type: message.uint8(1),
+    header: message.table(2),
+    bodyStart,
+    next: bodyStart + message.int64(3)
+  }
+}
+
+class ArrowReader {
+  constructor (source, options) {
+    this.source = source
+    this.fields = options.fields || null
+    this.schema = null
+    this.dictionaries = new Map()
+  }
+
+  // Columns of a RecordBatch table laid out as schema, fetching only the buffers of the fields read
+  async decode (recordBatch, bodyStart, schema, fields) {
+    if (recordBatch.table(3)) {
+      throw new Error('Compressed Arrow IPC bodies are not supported')
+    }
+    const view = recordBatch.view
+    const nodes = recordBatch.vector(1)
+    const buffers = recordBatch.vector(2)
+    const columns = []
+    let b = 0
+    for (let f = 0; f < schema.length; f++) {
+      const field = schema[f]
+      const count = bufferCount(field)
+      if (fields.includes(field)) {
+        const node = {
+          length: readInt64(view, nodes.start + 16 * f),
+          nullCount: readInt64(view, nodes.start + 16 * f + 8)
+        }
+        const ranges = []
+        for (let k = 0; k < count; k++) {
+          const p = buffers.start + 16 * (b + k)
+          ranges.push({ offset: readInt64(view, p), length: readInt64(view, p + 8) })
+        }
+        const start = ranges.length ? Math.min(...ranges.map(r => r.offset)) : 0
+        const end = ranges.length ? Math.max(...ranges.map(r => r.offset + r.length)) : 0
+        const bytes = await this.source.read(bodyStart + start, bodyStart + end)
+        ranges.forEach(r => { r.offset -= start })
+        columns.push(readColumn(field, bytes, ranges, node, this.dictionaries))
+      }
+      b += count
+    }
+    return columns
+  }
+
+  async loadDictionary (message) {
+    const id = message.header.int64(0)
+    const field = this.schema.find(f => f.dictionary && f.dictionary.id === id)
+    if (!field) return
+    // The dictionary batch holds one column of the value type
+    const valueField = Object.assign({}, field, { dictionary: null })
+    const [column] = await this.decode(message.header.table(1), message.bodyStart, [valueField], [valueField])
+    const values = []
+    for (let i = 0; i < column.values.length; i++) values.push(column.get(i))
+    const previous = this.dictionaries.get(id)
+    const all = message.header.bool(2) && previous ? previous.values.concat(values) : values
+    this.dictionaries.set(id, { type: column.type, values: all, nulls: all.includes(null) })
+  }
+
+  selected () {
+    return this.fields ? this.schema.filter(f => this.fields.includes(f.name)) : this.schema
+  }
+
+  metadata () {
+    return { schema: this.selected().map(f => ({ name: f.name, type: columnType(f, this.dictionaries) })) }
+  }
+
+  // Messages in file order: from the footer's blocks in the file format, one after another in the stream format
+  async * messages () {
+    const source = this.source
+    const head = await source.read(0, Math.min(8, source.size))
+    if (source.size >= 16 && isMagic(head, 0)) {
+      const tail = await source.read(source.size - 10, source.size)
+      if (!isMagic(tail, 4)) {
+        throw new Error('Truncated Arrow file')
+      }
+      const footerLength = new DataView(tail.buffer, tail.byteOffset, 4).getInt32(0, true)
+      const footer = Table.root(await source.read(source.size - 10 - footerLength, source.size - 10))
+      this.schema = readSchema(footer.table(1))
+      for (const field of [2, 3]) {
+        const blocks = footer.vector(field)
+        for (let i = 0; i < blocks.length; i++) {
+          const message = await readMessage(source, readInt64(footer.view, blocks.start + 24 * i))
+          if (message) yield message
+        }
+      }
+      return
+    }
+    let offset = 0
+    let message
+    while ((message = await readMessage(source, offset)) !== null) {
+      offset = message.next
+      yield message
+    }
+  }
+
+  async * batches (emitMetadata, batchSize) {
+    let announced = false
+    for await (const message of this.messages()) {
+      if (message.type === SCHEMA) {
+        this.schema = this.schema || readSchema(message.header)
+      } else if (message.type === DICTIONARY_BATCH) {
+        await this.loadDictionary(message)
+      } else if (message.type === RECORD_BATCH) {
+        if (!this.schema) {
+          throw new Error('Arrow record batch before its schema')
+        }
+        if (!announced) {
+          emitMetadata(this.metadata())
+          announced = true
+        }
+        const columns = await this.decode(message.header, message.bodyStart, this.schema, this.selected())
+        const batch = new RecordBatch(columns, message.header.int64(0))
+        yield { batches: split(batch, batchSize), loaded: message.next }
+      }
+    }
+  }
+}
+
+// Async iterator of {batches, loaded} for columnarStream(). Options: fields, batchSize
+function readArrow (source, emitMetadata, options) {
+  return new ArrowReader(source, options).batches(emitMetadata, options.batchSize)
+}
+
+function schemaFields (schema) {
+  return [undefined, F.tables(schema.map(field => [
+    F.string(field.name),
+    F.bool(true),
+    F.uint8(field.type === NUMBER ? FLOATING_POINT : UTF8),
+    F.table(field.type === NUMBER ? [F.int16(2)] : []),
+    undefined,
+    F.tables([])
+  ]))]
+}
+
+// Continuation marker, metadata length and the metadata padded to 8 bytes
+function frame (header, headerType, bodyLength) {
+  const meta = new Builder().finish([F.int16(V5), F.uint8(headerType), F.table(header), F.int64(bodyLength)])
+  const bytes = new Uint8Array(8 + align8(meta.length))
+  const view = new DataView(bytes.buffer)
+  view.setInt32(0, CONTINUATION, true)
+  view.setInt32(4, bytes.length - 8, true)
+  bytes.set(meta, 8)
+  return bytes
+}
+
+function writeBitmap (bytes, offset, isValid, length) {
+  for (let i = 0; i < length; i++) {
+    if (isValid(i)) bytes[offset + (i >> 3)] |= 1 << (i & 7)
+  }
+}
+
+// Body buffers of one column: validity and Float64 data, or validity, offsets and Utf8 data
+function columnBuffers (field, values) {
+  const length = values.values ? values.values.length : values.codes.length
+  const bitmap = new Uint8Array(align8(Math.ceil(length / 8)))
+  let nullCount = 0
+  if (field.type === NUMBER) {
+    const data = new Uint8Array(values.values.buffer, values.values.byteOffset, values.values.byteLength)
+    writeBitmap(bitmap, 0, (i) => values.values[i] === values.values[i], length)
+    values.values.forEach(v => { if (v !== v) nullCount += 1 })
+    return { length, nullCount, buffers: nullCount ? [bitmap, data] : [bitmap.subarray(0, 0), data] }
+  }
+  const encoded = values.dictionary.map(s => encoder.encode(s))
+  const offsets = new Int32Array(length + 1)
+  let size = 0
+  for (let i = 0; i < length; i++) {
+    const code = values.codes[i]
+    if (code === -1) nullCount += 1
+    else size += encoded[code].length
+    offsets[i + 1] = size
+  }
+  const data = new Uint8Array(size)
+  for (let i = 0; i < length; i++) {
+    if (values.codes[i] !== -1) data.set(encoded[values.codes[i]], offsets[i])
+  }
+  writeBitmap(bitmap, 0, (i) => values.codes[i] !== -1, length)
+  return {
+    length,
+    nullCount,
+    buffers: [nullCount ? bitmap : bitmap.subarray(0, 0), new Uint8Array(offsets.buffer), data]
+  }
+}
+
+// FileOutput serializer for the Arrow IPC file format, chunks become record batches as they come
+class ArrowSerializer {
+  constructor () {
+    this.binary = true
+    this.packer = new BatchPacker()
+    this.schema = null
+    this.sample = []
+    this.sampled = 0
+    this.offset = 0
+    this.blocks = []
+  }
+
+  start (schema) {
+    this.schema = schema
+    const magic = new Uint8Array(8)
+    magic.set(MAGIC)
+    const message = frame(schemaFields(schema), SCHEMA, 0)
+    this.offset = magic.length + message.length
+    return [magic, message]
+  }
+
+  recordBatch (batch) {
+    const columns = this.schema.map(field => columnBuffers(field, conform(batch, field)))
+    const buffers = []
+    let bodyLength = 0
+    columns.forEach(column => column.buffers.forEach(bytes => {
+      buffers.push({ offset: bodyLength, bytes })
+      bodyLength += align8(bytes.length)
+    }))
+    const header = frame([
+      F.int64(batch.length),
+      F.structs(16, columns, (builder, p, column) => {
+        builder.int64(p, column.length)
+        builder.int64(p + 8, column.nullCount)
+      }),
+      F.structs(16, buffers, (builder, p, buffer) => {
+        builder.int64(p, buffer.offset)
+        builder.int64(p + 8, buffer.bytes.length)
+      })
+    ], RECORD_BATCH, bodyLength)
+    const body = new Uint8Array(bodyLength)
+    buffers.forEach(buffer => body.set(buffer.bytes, buffer.offset))
+    this.blocks.push({ offset: this.offset, metaDataLength: header.length, bodyLength })
+    this.offset += header.length + bodyLength
+    return [header, body]
+  }
+
+  // The schema with types over the held batches, then the batches
+  flushSample () {
+    const parts = this.start(schemaOf(this.sample))
+    this.sample.forEach(batch => parts.push(...this.recordBatch(batch)))
+    this.sample = []
+    return parts
+  }
+
+  // Batches are kept past this call until the schema is written, pooled ones as views of their own
+  write (batches) {
+    const parts = []
+    batches.forEach(batch => {
+      if (this.schema) {
+        parts.push(...this.recordBatch(batch))
+        return
+      }
+      this.sample.push(RecordBatch.keep(batch))
+      this.sampled += batch.length
+      if (this.sampled >= SCHEMA_SAMPLE_ROWS) parts.push(...this.flushSample())
+    })
+    return concatBytes(parts)
+  }
+
+  serialize (chunk) {
+    return this.write(this.packer.add(chunk))
+  }
+
+  // End-of-stream marker, then the footer repeating the schema with the position of every batch
+  end () {
+    const parts = [this.write(this.packer.end())]
+    if (!this.schema) parts.push(...this.flushSample())
+    const eos = new Uint8Array(8)
+    new DataView(eos.buffer).setInt32(0, CONTINUATION, true)
+    const footer = new Builder().finish([
+      F.int16(V5),
+      F.table(schemaFields(this.schema)),
+      F.structs(24, [], () => {}),
+      F.structs(24, this.blocks, (builder, p, block) => {
+        builder.int64(p, block.offset)
+        builder.view.setInt32(p + 8, block.metaDataLength, true)
+        builder.int64(p + 16, block.bodyLength)
+      })
+    ])
+    const tail = new Uint8Array(10)
+    new DataView(tail.buffer).setInt32(0, footer.length, true)
+    tail.set(MAGIC, 4)
+    parts.push(eos, footer, tail)
+    return concatBytes(parts)
+  }
+}
+
+module.exports = {
+  readArrow,
+  ArrowSerializer
+}
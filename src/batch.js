@@ -0,0 +1,359 @@
+// Column-oriented record batches passed between transforms as 'batch' chunks.
+// Numeric columns are Float64Array with NaN for missing values,
+// everything else is dictionary-encoded into Int32Array codes with -1 for missing values.
+const { Lease } = require('./pool')
+
+const NUMBER = 'number'
+const STRING = 'string'
+
+const DEFAULT_BATCH_SIZE = 4096
+
+class Column {
+  constructor (name, type, values, dictionary) {
+    this.name = name
+    this.type = type
+    this.values = values
+    this.dictionary = dictionary || null
+  }
+
+  get (i) {
+    const v = this.values[i]
+    if (this.type === NUMBER) {
+      return v !== v ? null : v
+    }
+    return v === -1 ? null : this.dictionary[v]
+  }
+
+  // New column with rows picked by index
+  select (indices, length) {
+    const values = new this.values.constructor(length)
+    for (let i = 0; i < length; i++) {
+      values[i] = this.values[indices[i]]
+    }
+    return new Column(this.name, this.type, values, this.dictionary)
+  }
+}
+
+class RecordBatch {
+  constructor (columns, length, lease) {
+    this.isRecordBatch = true
+    this.columns = columns
+    this.length = length
+    this.index = Object.create(null)
+    columns.forEach((c, i) => { this.index[c.name] = i })
+    // Not enumerable, so it is neither cloned by postMessage nor counted as a field
+    Object.defineProperty(this, 'lease', { value: lease || null, writable: true })
+  }
+
+  static isBatch (chunk) {
+    return chunk !== null && typeof chunk === 'object' && chunk.isRecordBatch === true
+  }
+
+  // Restore prototypes after a structured clone (postMessage)
+  static revive (chunk) {
+    if (chunk instanceof RecordBatch || !RecordBatch.isBatch(chunk)) {
+      return chunk
+    }
+    return new RecordBatch(
+      chunk.columns.map(c => new Column(c.name, c.type, c.values, c.dictionary)),
+      chunk.length
+    )
+  }
+
+  // Buffers that can be transferred instead of copied by postMessage. A transfer detaches the buffer
+  // under every batch viewing it, so buffers another live batch may hold are copied: pooled ones with
+  // more than one reference, and unpooled ones a column only views part of, like slices.
+  static transferables (chunks) {
+    const buffers = new Set()
+    chunks.forEach(chunk => {
+      if (!RecordBatch.isBatch(chunk) || (chunk.lease && chunk.lease.count > 1)) return
+      chunk.columns.forEach(c => {
+        if (chunk.lease || c.values.byteLength === c.values.buffer.byteLength) buffers.add(c.values.buffer)
+      })
+    })
+    return Array.from(buffers)
+  }
+
+  // Hands a pooled batch back, see pool.js for the ownership rules. Anything else passes through.
+  static release (chunk) {
+    if (RecordBatch.isBatch(chunk) && chunk.lease) {
+      chunk.lease.release()
+      chunk.lease = null
+    }
+  }
+
+  // View for batches held past the run (previews, the stage cache): its reference is never given back,
+  // so the buffers are not recycled while it lives and whoever reads it need not release it
+  static keep (chunk) {
+    if (!RecordBatch.isBatch(chunk) || !chunk.lease) return chunk
+    const view = chunk.share(chunk.columns, chunk.length)
+    view.lease = null
+    return view
+  }
+
+  // Another batch over the same pooled buffers holds its own reference
+  share (columns, length) {
+    if (this.lease) this.lease.retain()
+    return new RecordBatch(columns, length, this.lease)
+  }
+
+  get names () {
+    return this.columns.map(c => c.name)
+  }
+
+  column (name) {
+    const i = this.index[name]
+    return typeof i === 'undefined' ? null : this.columns[i]
+  }
+
+  get (i, name) {
+    const column = this.column(name)
+    return column ? column.get(i) : null
+  }
+
+  row (i) {
+    const record = {}
+    for (const column of this.columns) {
+      record[column.name] = column.get(i)
+    }
+    return record
+  }
+
+  // Named columns only, sharing buffers
+  project (names) {
+    return this.share(names.map(name => this.column(name)).filter(c => c !== null), this.length)
+  }
+
+  // Columns added, or replacing the ones with the same name, sharing the other buffers
+  withColumns (columns) {
+    const kept = this.columns.filter(c => !columns.some(added => added.name === c.name))
+    return this.share(kept.concat(columns), this.length)
+  }
+
+  // Rows picked by a selection vector
+  select (indices, length) {
+    return new RecordBatch(this.columns.map(c => c.select(indices, length)), length)
+  }
+
+  // Rows [start, end) as views over the same buffers
+  slice (start, end) {
+    end = Math.min(end, this.length)
+    return this.share(
+      this.columns.map(c => new Column(c.name, c.type, c.values.subarray(start, end), c.dictionary)),
+      end - start
+    )
+  }
+
+  toObjects () {
+    const records = new Array(this.length)
+    for (let i = 0; i < this.length; i++) {
+      records[i] = this.row(i)
+    }
+    return records
+  }
+}
+
+// Accumulates one column of a batch, numeric until the first non-numeric value.
+// With a pool, buffers come from it and finished columns are views over them.
+class ColumnBuilder {
+  constructor (name, size, length, pool) {
+    this.name = name
+    this.type = NUMBER
+    this.pool = pool || null
+    this.values = this.pool ? this.pool.acquire(Float64Array, size) : new Float64Array(size)
+    this.values.fill(NaN, 0, length)
+    this.dictionary = null
+    this.codes = null
+  }
+
+  code (value) {
+    let code = this.codes.get(value)
+    if (typeof code === 'undefined') {
+      code = this.dictionary.length
+      this.dictionary.push(value)
+      this.codes.set(value, code)
+    }
+    return code
+  }
+
+  toStrings (length) {
+    const numbers = this.values
+    this.type = STRING
+    this.values = this.pool ? this.pool.acquire(Int32Array, numbers.length) : new Int32Array(numbers.length)
+    this.dictionary = []
+    this.codes = new Map()
+    for (let i = 0; i < length; i++) {
+      this.values[i] = numbers[i] !== numbers[i] ? -1 : this.code(String(numbers[i]))
+    }
+    if (this.pool) this.pool.recycle(numbers)
+  }
+
+  set (i, value) {
+    if (value === null || typeof value === 'undefined' || value === '') {
+      this.values[i] = this.type === NUMBER ? NaN : -1
+    } else if (this.type === NUMBER) {
+      if (typeof value === 'number') {
+        this.values[i] = value
+      } else {
+        this.toStrings(i)
+        this.values[i] = this.code(String(value))
+      }
+    } else {
+      this.values[i] = this.code(String(value))
+    }
+  }
+
+  finish (length) {
+    const values = length === this.values.length
+      ? this.values
+      : this.pool ? this.values.subarray(0, length) : this.values.slice(0, length)
+    return new Column(this.name, this.type, values, this.dictionary)
+  }
+}
+
+// pool: optional BufferPool, batches then carry a Lease over their buffers
+class BatchBuilder {
+  constructor (names, size, pool) {
+    this.size = size || DEFAULT_BATCH_SIZE
+    this.pool = pool || null
+    this.names = []
+    this.index = Object.create(null)
+    this.builders = []
+    this.length = 0
+    ;(names || []).forEach(name => this.addColumn(name))
+  }
+
+  addColumn (name) {
+    this.index[name] = this.names.length
+    this.names.push(name)
+    this.builders.push(new ColumnBuilder(name, this.size, this.length, this.pool))
+  }
+
+  get full () {
+    return this.length >= this.size
+  }
+
+  // Append a row of values aligned with names
+  append (values) {
+    const n = this.builders.length
+    for (let j = 0; j < n; j++) {
+      this.builders[j].set(this.length, values[j])
+    }
+    this.length += 1
+  }
+
+  // Append values[indices[j]] for each column j
+  appendAt (values, indices) {
+    const n = this.builders.length
+    for (let j = 0; j < n; j++) {
+      this.builders[j].set(this.length, values[indices[j]])
+    }
+    this.length += 1
+  }
+
+  // Append an object, adding columns for keys not seen yet
+  appendObject (record) {
+    for (const name in record) {
+      if (!(name in this.index)) this.addColumn(name)
+    }
+    const n = this.builders.length
+    for (let j = 0; j < n; j++) {
+      this.builders[j].set(this.length, record[this.names[j]])
+    }
+    this.length += 1
+  }
+
+  flush () {
+    const length = this.length
+    const lease = this.pool ? new Lease(this.pool, this.builders.map(b => b.values)) : null
+    const columns = this.builders.map(b => b.finish(length))
+    this.builders = this.names.map(name => new ColumnBuilder(name, this.size, 0, this.pool))
+    this.length = 0
+    return new RecordBatch(columns, length, lease)
+  }
+}
+
+// Append-only list of batches with row addressing across them
+class BatchStore {
+  constructor (maxRows) {
+    this.maxRows = maxRows || Infinity
+    this.batches = []
+    this.offsets = []
+    this.length = 0
+    this.seen = 0
+    this.names = []
+    this.index = Object.create(null)
+    this.builder = null
+  }
+
+  // Objects are packed into batches, sealed whenever the store is read
+  appendObject (record) {
+    if (this.length + (this.builder ? this.builder.length : 0) >= this.maxRows) {
+      this.seen += 1
+      return false
+    }
+    if (!this.builder) {
+      this.builder = new BatchBuilder(null)
+    }
+    this.builder.appendObject(record)
+    if (this.builder.full) {
+      this.seal()
+    }
+    return true
+  }
+
+  seal () {
+    if (this.builder && this.builder.length) {
+      this.add(this.builder.flush())
+    }
+  }
+
+  // Returns false once the store is full, later rows are only counted
+  add (batch) {
+    this.seen += batch.length
+    if (this.length >= this.maxRows) {
+      return false
+    }
+    this.batches.push(batch)
+    this.offsets.push(this.length)
+    this.length += Math.min(batch.length, this.maxRows - this.length)
+    batch.names.forEach(name => {
+      if (!(name in this.index)) {
+        this.index[name] = this.names.length
+        this.names.push(name)
+      }
+    })
+    return true
+  }
+
+  // Batch holding row i and the row's position inside it
+  locate (i) {
+    let lo = 0
+    let hi = this.offsets.length - 1
+    while (lo < hi) {
+      const mid = (lo + hi + 1) >> 1
+      if (this.offsets[mid] <= i) {
+        lo = mid
+      } else {
+        hi = mid - 1
+      }
+    }
+    return [this.batches[lo], i - this.offsets[lo]]
+  }
+
+  get (i, name) {
+    const [batch, row] = this.locate(i)
+    return batch.get(row, name)
+  }
+}
+
+module.exports = {
+  NUMBER,
+  STRING,
+  DEFAULT_BATCH_SIZE,
+  Column,
+  RecordBatch,
+  ColumnBuilder,
+  BatchBuilder,
+  BatchStore
+}
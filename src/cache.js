@@ -0,0 +1,152 @@
+// In-memory cache of stage outputs, so a re-run can resume after the last unchanged stage.
+// A stage's key covers its name, params and the key of the stage before it.
+// Only record and batch streams are kept, within a byte budget shared by the entries and the outputs
+// still being recorded, least recently used entries go first.
+const { Readable } = require('stream')
+const through2 = require('through2')
+const { RecordBatch } = require('./batch')
+const { hash32 } = require('./sketches')
+const { recordSize } = require('./memory')
+
+const DEFAULT_BUDGET = 512 * 1024 * 1024
+const FIELD_SIZE = 16 // rough bytes per dictionary entry besides its string data
+
+// Files are identified by name, size and modification time
+function paramsReplacer (key, value) {
+  if (typeof Blob !== 'undefined' && value instanceof Blob) {
+    return { name: value.name, size: value.size, lastModified: value.lastModified }
+  }
+  return value
+}
+
+function stageKey (stage, upstreamKey) {
+  const text = `${upstreamKey}|${stage.name}|${JSON.stringify(stage.params, paramsReplacer)}`
+  return hash32(text).toString(16).padStart(8, '0') + hash32(text, 0x9747b28c).toString(16).padStart(8, '0')
+}
+
+// Keys of a planned chain, each depending on all stages before it
+function stageKeys (stages) {
+  const keys = []
+  let key = ''
+  for (const stage of stages) {
+    key = stageKey(stage, key)
+    keys.push(key)
+  }
+  return keys
+}
+
+function dictionarySize (dictionary) {
+  let size = 0
+  for (const s of dictionary) size += FIELD_SIZE + s.length * 2
+  return size
+}
+
+function chunkSize (chunk) {
+  if (RecordBatch.isBatch(chunk)) {
+    return chunk.columns.reduce((size, c) =>
+      size + c.values.byteLength + (c.dictionary ? dictionarySize(c.dictionary) : 0), 0)
+  }
+  return chunk !== null && typeof chunk === 'object' ? recordSize(chunk) : FIELD_SIZE
+}
+
+class StageCache {
+  constructor (budget) {
+    this.budget = budget || DEFAULT_BUDGET
+    this.size = 0
+    this.pending = 0 // bytes held by recorders that have not committed yet
+    this.entries = new Map() // key -> {chunks, size}, in least recently used order
+    this.metadata = new Map()
+  }
+
+  get (key) {
+    const entry = this.entries.get(key)
+    if (entry) {
+      this.entries.delete(key)
+      this.entries.set(key, entry)
+    }
+    return entry
+  }
+
+  evict (needed) {
+    for (const [key, entry] of this.entries) {
+      if (this.size + this.pending + needed <= this.budget) break
+      this.entries.delete(key)
+      this.size -= entry.size
+    }
+  }
+
+  // Pass-through stream that stores what passes and commits it on end. Older entries are evicted
+  // to make room as it goes, recording stops for good once the recordings in progress alone
+  // outgrow the budget. What it holds is charged to memory, the run's MemoryManager, when given.
+  recorder (key, memory) {
+    let chunks = []
+    let size = 0
+    const cache = this
+    const reservation = memory ? memory.register('Cache', () => size) : null
+    const settle = () => {
+      cache.pending -= size
+      if (reservation) reservation.release()
+    }
+    const stream = through2.obj(function (chunk, enc, callback) {
+      if (chunks !== null) {
+        const n = chunkSize(chunk)
+        size += n
+        cache.pending += n
+        cache.evict(0)
+        if (cache.size + cache.pending > cache.budget) {
+          settle()
+          chunks = null
+          size = 0
+        } else {
+          chunks.push(RecordBatch.keep(chunk))
+        }
+      }
+      callback(null, chunk)
+    }, function (callback) {
+      if (chunks !== null) {
+        settle()
+        cache.evict(size)
+        cache.entries.set(key, { chunks, size })
+        cache.size += size
+        chunks = null
+        size = 0
+      }
+      callback()
+    })
+    // Cancelled and failed runs commit nothing
+    stream.on('close', () => {
+      if (chunks !== null) {
+        settle()
+        chunks = null
+        size = 0
+      }
+    })
+    return stream
+  }
+
+  // Replays a committed entry
+  readStream (entry) {
+    let i = 0
+    return new Readable({
+      objectMode: true,
+      read () {
+        let more = true
+        while (more && i < entry.chunks.length) {
+          more = this.push(entry.chunks[i++])
+        }
+        if (i === entry.chunks.length) this.push(null)
+      }
+    })
+  }
+
+  clear () {
+    this.entries.clear()
+    this.metadata.clear()
+    this.size = 0
+  }
+}
+
+module.exports = {
+  stageKeys,
+  StageCache
+}
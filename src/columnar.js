@@ -0,0 +1,247 @@
+// Shared parts of the Arrow and Parquet stages. Readers get random access to the file, so they
+// only fetch the metadata and the byte ranges of the columns they decode. Writers fix the columns
+// and their types over the rows they hold before writing the schema, a column is text when any
+// of those batches has it as text.
+const fs = require('fs')
+const { Readable } = require('stream')
+const { NUMBER, STRING, DEFAULT_BATCH_SIZE, RecordBatch, BatchBuilder } = require('./batch')
+const { blocking } = require('./streams')
+const { compileCast } = require('./schema')
+
+const castToNumber = compileCast(NUMBER)
+
+function concatBytes (parts) {
+  if (parts.length === 1) return parts[0]
+  let size = 0
+  parts.forEach(p => { size += p.length })
+  const bytes = new Uint8Array(size)
+  let offset = 0
+  parts.forEach(p => {
+    bytes.set(p, offset)
+    offset += p.length
+  })
+  return bytes
+}
+
+// {size, read(start, end)} over a File or Blob, a path in headless runs, or bytes already in memory
+function openSource (file) {
+  if (file instanceof Uint8Array) {
+    return {
+      size: file.length,
+      read: async (start, end) => file.subarray(start, Math.min(end, file.length)),
+      close () {}
+    }
+  }
+  if (typeof file === 'string') {
+    let fd = fs.openSync(file, 'r')
+    return {
+      size: fs.fstatSync(fd).size,
+      read: (start, end) => new Promise((resolve, reject) => {
+        // A fresh buffer per read, so typed arrays can view it at offset 0
+        const bytes = new Uint8Array(Math.max(0, end - start))
+        fs.read(fd, bytes, 0, bytes.length, start, (err, n) => err ? reject(err) : resolve(bytes.subarray(0, n)))
+      }),
+      close () {
+        if (fd === null) return
+        fs.closeSync(fd)
+        fd = null
+      }
+    }
+  }
+  return {
+    size: file.size,
+    read: async (start, end) => new Uint8Array(await file.slice(start, end).arrayBuffer()),
+    close () {}
+  }
+}
+
+// Typed array over bytes[start, end), copied when the offset is not aligned for the type
+function typedView (Type, bytes, start, end) {
+  const offset = bytes.byteOffset + start
+  const length = (end - start) / Type.BYTES_PER_ELEMENT
+  if (offset % Type.BYTES_PER_ELEMENT === 0) {
+    return new Type(bytes.buffer, offset, length)
+  }
+  return new Type(bytes.slice(start, end).buffer, 0, length)
+}
+
+// Batches of at most size rows, views over the decoded buffers
+function split (batch, size) {
+  if (batch.length <= size) return [batch]
+  const batches = []
+  for (let start = 0; start < batch.length; start += size) {
+    batches.push(batch.slice(start, start + size))
+  }
+  return batches
+}
+
+// Emits the batches of an async iterator of {batches, loaded}, pulled only as fast as downstream reads
+class ColumnarStream extends Readable {
+  constructor (source, read) {
+    super({ objectMode: true })
+    this.source = source
+    this.iterator = read(source, (metadata) => this.emit('metadata', metadata))
+    this.emitsProgress = true
+    this.reading = false
+    this.wantMore = false
+  }
+
+  async _pump () {
+    while (true) {
+      const { done, value } = await this.iterator.next()
+      if (done) {
+        this.source.close()
+        this.push(null)
+        return
+      }
+      this.emit('progress', value.loaded, this.source.size)
+      let more = true
+      for (const batch of value.batches) {
+        more = this.push(batch)
+      }
+      if (!more) return
+    }
+  }
+
+  _read () {
+    if (this.reading) {
+      this.wantMore = true
+      return
+    }
+    this.reading = true
+    this._pump()
+      .catch(err => this.destroy(err))
+      .then(() => {
+        this.reading = false
+        if (this.wantMore) {
+          this.wantMore = false
+          this._read()
+        }
+      })
+  }
+
+  _destroy (err, callback) {
+    this.source.close()
+    callback(err)
+  }
+}
+
+// Stage stream for a reader: read(source, emitMetadata) is an async iterator of {batches, loaded}.
+// With the loader's File the file is read by range, otherwise the loader's chunks are collected first.
+function columnarStream (file, read) {
+  if (file) {
+    return new ColumnarStream(openSource(file), read)
+  }
+  const parts = []
+  const stream = blocking({
+    write (chunk) {
+      if (typeof chunk === 'string') {
+        throw new Error('Columnar formats need binary input, set the loader encoding to Binary')
+      }
+      parts.push(chunk)
+    },
+    results: async function * () {
+      const source = openSource(concatBytes(parts))
+      parts.length = 0
+      for await (const { batches } of read(source, (metadata) => stream.emit('metadata', metadata))) {
+        yield batches
+      }
+    }
+  })
+  return stream
+}
+
+// Plain records are packed into batches, text is refused
+class BatchPacker {
+  constructor () {
+    this.builder = null
+  }
+
+  // Batches ready to be written, in input order
+  add (chunk) {
+    if (typeof chunk === 'string' || chunk instanceof Uint8Array) {
+      throw new Error('Arrow and Parquet output need records or batches, not text')
+    }
+    if (RecordBatch.isBatch(chunk)) {
+      return this.end().concat([chunk])
+    }
+    if (!this.builder) {
+      this.builder = new BatchBuilder(null, DEFAULT_BATCH_SIZE)
+    }
+    this.builder.appendObject(chunk)
+    return this.builder.full ? [this.builder.flush()] : []
+  }
+
+  end () {
+    return this.builder && this.builder.length ? [this.builder.flush()] : []
+  }
+}
+
+// Columns in order of first appearance, text where any batch has text.
+// Batches are typed on their own, a numeric column of one can be text in the next.
+function schemaOf (batches) {
+  const schema = []
+  const fields = new Map()
+  batches.forEach(batch => batch.columns.forEach(c => {
+    const field = fields.get(c.name)
+    if (!field) {
+      const added = { name: c.name, type: c.type }
+      fields.set(c.name, added)
+      schema.push(added)
+    } else if (c.type === STRING) {
+      field.type = STRING
+    }
+  }))
+  return schema
+}
+
+// Column values as the schema has them: {values} Float64Array for numbers,
+// {codes, dictionary} for text. Text columns take numbers as text. Text reaching a column written
+// as numbers already keeps the values that read as numbers, the rest is written as missing.
+function conform (batch, field) {
+  const column = batch.column(field.name)
+  if (field.type === NUMBER) {
+    if (!column) return { values: new Float64Array(batch.length).fill(NaN) }
+    if (column.type === NUMBER) return { values: column.values }
+    const numbers = column.dictionary.map(s => {
+      const n = castToNumber(s)
+      return typeof n === 'number' ? n : NaN
+    })
+    const values = new Float64Array(batch.length)
+    for (let i = 0; i < batch.length; i++) {
+      const code = column.values[i]
+      values[i] = code < 0 ? NaN : numbers[code]
+    }
+    return { values }
+  }
+  if (!column) return { codes: new Int32Array(batch.length).fill(-1), dictionary: [] }
+  if (column.type === STRING) return { codes: column.values, dictionary: column.dictionary }
+  const codes = new Int32Array(batch.length)
+  const dictionary = []
+  const index = new Map()
+  for (let i = 0; i < batch.length; i++) {
+    const v = column.values[i]
+    if (v !== v) {
+      codes[i] = -1
+      continue
+    }
+    const s = String(v)
+    if (!index.has(s)) {
+      index.set(s, dictionary.length)
+      dictionary.push(s)
+    }
+    codes[i] = index.get(s)
+  }
+  return { codes, dictionary }
+}
+
+module.exports = {
+  concatBytes,
+  openSource,
+  typedView,
+  split,
+  columnarStream,
+  BatchPacker,
+  schemaOf,
+  conform
+}
@@ -0,0 +1,131 @@
+const { Duplex, PassThrough } = require('stream')
+const unzip = require('unzip-stream')
+const { duplex } = require('./streams')
+
+function toBuffer (chunk) {
+  if (typeof chunk === 'string') {
+    throw new Error('Decompress needs binary input, set the loader encoding to Binary')
+  }
+  return Buffer.isBuffer(chunk) ? chunk : Buffer.from(chunk.buffer, chunk.byteOffset, chunk.byteLength)
+}
+
+function detect (chunk) {
+  if (chunk[0] === 0x1f && chunk[1] === 0x8b) return 'Gzip'
+  if (chunk[0] === 0x50 && chunk[1] === 0x4b) return 'Zip'
+  return 'None'
+}
+
+// Platform DecompressionStream bridged to a node-style duplex with backpressure on both sides
+function gunzip () {
+  if (typeof DecompressionStream === 'undefined') {
+    throw new Error('Gzip needs DecompressionStream, which this browser does not support')
+  }
+  const ds = new DecompressionStream('gzip')
+  const writer = ds.writable.getWriter()
+  const reader = ds.readable.getReader()
+  let pulling = false
+
+  const stream = new Duplex({
+    write (chunk, enc, callback) {
+      writer.ready
+        .then(() => {
+          writer.write(chunk).catch(err => stream.destroy(err))
+          callback()
+        })
+        .catch(callback)
+    },
+    final (callback) {
+      writer.close().then(() => callback(), callback)
+    },
+    read () {
+      if (pulling) return
+      pulling = true
+      // Returned so a failure on any later read reaches the catch below
+      const pull = () => reader.read().then(({ done, value }) => {
+        if (done) {
+          stream.push(null)
+        } else if (stream.push(Buffer.from(value.buffer, value.byteOffset, value.byteLength))) {
+          return pull()
+        } else {
+          pulling = false
+        }
+      })
+      pull().catch(err => stream.destroy(err))
+    }
+  })
+  return stream
+}
+
+// Streams one entry of a zip archive: the named one, or the first file
+function unzipEntry (name) {
+  const parser = unzip.Parse()
+  const output = new PassThrough()
+  let found = false
+  parser.on('entry', entry => {
+    if (!found && entry.type === 'File' && (!name || entry.path === name)) {
+      found = true
+      entry.pipe(output)
+    } else {
+      entry.autodrain()
+    }
+  })
+  parser.on('finish', () => {
+    if (!found) output.destroy(new Error(name ? `No entry ${name} in archive` : 'Empty archive'))
+  })
+  return duplex(parser, output)
+}
+
+// Picks the decoder from the format option or the magic bytes of the first chunk
+class DecompressStream extends Duplex {
+  constructor (format, entry) {
+    super()
+    this.format = format
+    this.entry = entry
+    this.inner = null
+  }
+
+  _init (chunk) {
+    const format = this.format === 'Auto' ? detect(chunk) : this.format
+    this.inner = format === 'Gzip'
+      ? gunzip()
+      : format === 'Zip'
+        ? unzipEntry(this.entry)
+        : new PassThrough()
+    this.inner.on('data', c => {
+      if (!this.push(c)) this.inner.pause()
+    })
+    this.inner.on('end', () => this.push(null))
+    this.inner.on('error', err => this.destroy(err))
+  }
+
+  _write (chunk, enc, callback) {
+    try {
+      chunk = toBuffer(chunk)
+      if (!this.inner) this._init(chunk)
+    } catch (err) {
+      return callback(err)
+    }
+    if (this.inner.write(chunk)) {
+      callback()
+    } else {
+      this.inner.once('drain', callback)
+    }
+  }
+
+  _final (callback) {
+    if (this.inner) {
+      this.inner.end()
+    } else {
+      this.push(null)
+    }
+    callback()
+  }
+
+  _read () {
+    if (this.inner) this.inner.resume()
+  }
+}
+
+module.exports = {
+  DecompressStream
+}
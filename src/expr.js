@@ -0,0 +1,220 @@
+// filtrex expressions compiled once and evaluated on records, value arrays or whole batches,
+// as predicates or as computed fields
+const { compileExpression } = require('filtrex')
+const { ColumnBuilder } = require('./batch')
+
+const KEYWORDS = new Set(['and', 'or', 'not', 'in', 'if', 'then', 'else', 'true', 'false'])
+
+// filtrex reports unknown properties and type errors as returned error objects
+function truthy (value) {
+  return !!value && !(value instanceof Error)
+}
+
+// Names of the fields an expression reads, quoted 'field names' included
+function expressionFields (expression) {
+  const fields = new Set()
+  const tokens = /'((?:[^'\\]|\\.)*)'|"(?:[^"\\]|\\.)*"|([A-Za-z_$][\w$.]*)(\s*\()?/g
+  let m
+  while ((m = tokens.exec(expression)) !== null) {
+    if (typeof m[1] !== 'undefined') {
+      fields.add(m[1])
+    } else if (m[2] && !m[3] && !KEYWORDS.has(m[2])) {
+      fields.add(m[2])
+    }
+  }
+  return Array.from(fields)
+}
+
+// Predicate on plain objects
+function compileRecordFilter (expression) {
+  const fn = compileExpression(expression)
+  return (record) => truthy(fn(record))
+}
+
+// Predicate on value arrays aligned with names, no object is built for the row
+function compileValuesFilter (expression, names) {
+  const index = Object.create(null)
+  names.forEach((name, i) => { index[name] = i })
+  let values = null
+  const fn = compileExpression(expression, {
+    customProp: (name) => values[index[name]]
+  })
+  return (row) => {
+    values = row
+    return truthy(fn(null))
+  }
+}
+
+// Selection vector of the batch rows matching an expression
+function compileBatchFilter (expression) {
+  let columns = null
+  let row = 0
+  const fn = compileExpression(expression, {
+    customProp: (name) => {
+      const column = columns[name]
+      return column ? column.get(row) : undefined
+    }
+  })
+  return (batch) => {
+    columns = Object.create(null)
+    batch.columns.forEach(c => { columns[c.name] = c })
+    const selection = new Int32Array(batch.length)
+    let n = 0
+    for (row = 0; row < batch.length; row++) {
+      if (truthy(fn(null))) {
+        selection[n++] = row
+      }
+    }
+    return [selection, n]
+  }
+}
+
+// "name = expression" per line or separated by semicolons, == stays a comparison
+function parseAssignments (text) {
+  return (text || '').split(/[;\n]/).map(s => s.trim()).filter(s => s.length).map(item => {
+    const m = /^('(?:[^'\\]|\\.)*'|[A-Za-z_$][\w$.]*)\s*=(?!=)\s*(.+)$/.exec(item)
+    if (!m) {
+      throw new Error(`Expected name = expression: ${item}`)
+    }
+    const name = m[1][0] === "'" ? m[1].slice(1, -1) : m[1]
+    return { name, expression: m[2] }
+  })
+}
+
+// Errors filtrex returns for bad input become missing values, booleans 1 and 0 so batch columns stay numeric
+function result (value) {
+  if (value instanceof Error) return null
+  return typeof value === 'boolean' ? +value : value
+}
+
+// Record with the assigned fields, later expressions see the results of earlier ones
+function compileRecordMap (assignments) {
+  const fns = assignments.map(a => compileExpression(a.expression))
+  return (record) => {
+    const out = Object.assign({}, record)
+    for (let j = 0; j < fns.length; j++) {
+      out[assignments[j].name] = result(fns[j](out))
+    }
+    return out
+  }
+}
+
+// Batch with one new column per assignment, each expression compiled once and run in a loop over the rows.
+// Other columns keep their buffers.
+function compileBatchMap (assignments) {
+  let columns = null
+  let row = 0
+  const fns = assignments.map(a => compileExpression(a.expression, {
+    customProp: (name) => {
+      const column = columns[name]
+      return column ? column.get(row) : undefined
+    }
+  }))
+  return (batch) => {
+    columns = Object.create(null)
+    batch.columns.forEach(c => { columns[c.name] = c })
+    const added = []
+    for (let j = 0; j < fns.length; j++) {
+      const builder = new ColumnBuilder(assignments[j].name, batch.length, 0)
+      for (row = 0; row < batch.length; row++) {
+        builder.set(row, result(fns[j](null)))
+      }
+      const column = builder.finish(batch.length)
+      columns[column.name] = column
+      added.push(column)
+    }
+    return batch.withColumns(added)
+  }
+}
+
+// Both sides must hold
+function andExpressions (a, b) {
+  return a ? `(${a}) and (${b})` : b
+}
+
+// Parenthesized as a whole, e.g. the sides andExpressions() wraps
+function wrapped (s) {
+  if (s[0] !== '(' || s[s.length - 1] !== ')') return false
+  let depth = 0
+  for (let i = 0; i < s.length; i++) {
+    if (s[i] === '(') depth += 1
+    else if (s[i] === ')') depth -= 1
+    if (depth === 0) return i === s.length - 1
+  }
+  return false
+}
+
+const word = (s, i, w) => s.startsWith(w, i) && !/[\w$.]/.test(s[i - 1] || '') && !/[\w$.]/.test(s[i + w.length] || '')
+
+// Top-level parts of an expression joined by and. Any other top-level keyword binds looser
+// or changes the meaning of the parts, the expression is then kept whole.
+function conjuncts (expression) {
+  const s = expression.trim()
+  if (wrapped(s)) return conjuncts(s.slice(1, -1))
+  const parts = []
+  let depth = 0
+  let quote = null
+  let start = 0
+  for (let i = 0; i < s.length; i++) {
+    const ch = s[i]
+    if (quote) {
+      if (ch === '\\') i += 1
+      else if (ch === quote) quote = null
+    } else if (ch === '"' || ch === "'") {
+      quote = ch
+    } else if (ch === '(') {
+      depth += 1
+    } else if (ch === ')') {
+      depth -= 1
+    } else if (depth === 0 && word(s, i, 'and')) {
+      parts.push(s.slice(start, i))
+      start = i + 3
+      i += 2
+    } else if (depth === 0 && ['or', 'not', 'if', 'then', 'else'].some(w => word(s, i, w))) {
+      return [s]
+    }
+  }
+  if (!parts.length) return [s]
+  parts.push(s.slice(start))
+  return [].concat(...parts.map(conjuncts))
+}
+
+const FLIPPED = { '==': '==', '!=': '!=', '<': '>', '<=': '>=', '>': '<', '>=': '<=' }
+const FIELD = `'((?:[^'\\\\]|\\\\.)*)'|([A-Za-z_$][\\w$.]*)`
+const CONSTANT = `(-?(?:\\d+\\.?\\d*|\\.\\d+)(?:[eE][-+]?\\d+)?)|"((?:[^"\\\\]|\\\\.)*)"`
+const FIELD_FIRST = new RegExp(`^(?:${FIELD})\\s*(==|!=|<=|>=|<|>)\\s*(?:${CONSTANT})$`)
+const CONSTANT_FIRST = new RegExp(`^(?:${CONSTANT})\\s*(==|!=|<=|>=|<|>)\\s*(?:${FIELD})$`)
+
+// {field, op, value} for the conjuncts comparing a field to a number or a string,
+// enough to skip data by min/max statistics; the full expression still runs on what is read
+function comparisons (expression) {
+  const found = []
+  const constant = (number, string) => typeof number !== 'undefined' ? +number : string.replace(/\\(.)/g, '$1')
+  for (const part of expression ? conjuncts(expression) : []) {
+    let m = FIELD_FIRST.exec(part.trim())
+    if (m) {
+      const field = typeof m[1] !== 'undefined' ? m[1] : m[2]
+      if (!KEYWORDS.has(field)) found.push({ field, op: m[3], value: constant(m[4], m[5]) })
+      continue
+    }
+    m = CONSTANT_FIRST.exec(part.trim())
+    if (m) {
+      const field = typeof m[4] !== 'undefined' ? m[4] : m[5]
+      if (!KEYWORDS.has(field)) found.push({ field, op: FLIPPED[m[3]], value: constant(m[1], m[2]) })
+    }
+  }
+  return found
+}
+
+module.exports = {
+  truthy,
+  expressionFields,
+  compileRecordFilter,
+  compileValuesFilter,
+  compileBatchFilter,
+  parseAssignments,
+  compileRecordMap,
+  compileBatchMap,
+  andExpressions,
+  comparisons
+}
@@ -0,0 +1,147 @@
+// Build-side indexes for Join. The lookup table is read once, into a hash index on its key or,
+// for range joins, into an array sorted on the range start; probe records are then matched one at a time.
+// Lookup rows are projected when indexed, so a match only has to be merged into the probe record.
+// Indexes outlive the run that built them and are reused while the lookup file and its settings stay the same.
+const { RecordBatch } = require('./batch')
+const { recordSize } = require('./memory')
+
+const MAX_CACHED = 4
+const NO_MATCHES = []
+
+const isMissing = (v) => v === null || typeof v === 'undefined' || v === ''
+
+// Lookup fields added to matched records: all but the join fields, optionally prefixed
+function lookupFields (record, exclude, prefix) {
+  const fields = {}
+  for (const name in record) {
+    if (!exclude.includes(name)) fields[prefix + name] = record[name]
+  }
+  return fields
+}
+
+// Equality join, keys compared as strings so 5 from one file matches "5" from another
+class HashIndex {
+  constructor () {
+    this.map = new Map()
+  }
+
+  add (key, fields) {
+    const k = String(key)
+    const list = this.map.get(k)
+    if (list) {
+      list.push(fields)
+    } else {
+      this.map.set(k, [fields])
+    }
+  }
+
+  seal () {}
+
+  match (value) {
+    return isMissing(value) ? NO_MATCHES : (this.map.get(String(value)) || NO_MATCHES)
+  }
+}
+
+// Range join on numbers, a probe value v matches rows with from <= v < to.
+// Ranges may overlap: a running maximum of range ends bounds the backward scan from the last start <= v.
+class RangeIndex {
+  constructor () {
+    this.entries = []
+  }
+
+  add (from, to, fields) {
+    this.entries.push({ from: +from, to: +to, fields })
+  }
+
+  seal () {
+    const entries = this.entries.filter(e => !isNaN(e.from) && !isNaN(e.to)).sort((a, b) => a.from - b.from)
+    this.starts = new Float64Array(entries.length)
+    this.ends = new Float64Array(entries.length)
+    this.maxEnds = new Float64Array(entries.length)
+    this.fields = entries.map(e => e.fields)
+    let maxEnd = -Infinity
+    entries.forEach((e, i) => {
+      this.starts[i] = e.from
+      this.ends[i] = e.to
+      maxEnd = Math.max(maxEnd, e.to)
+      this.maxEnds[i] = maxEnd
+    })
+    this.entries = null
+  }
+
+  match (value) {
+    if (isMissing(value)) return NO_MATCHES
+    const v = +value
+    let lo = 0
+    let hi = this.starts.length
+    while (lo < hi) {
+      const mid = (lo + hi) >>> 1
+      if (this.starts[mid] <= v) lo = mid + 1
+      else hi = mid
+    }
+    let matches = NO_MATCHES
+    for (let i = lo - 1; i >= 0 && this.maxEnds[i] > v; i--) {
+      if (this.ends[i] > v) {
+        if (matches === NO_MATCHES) matches = []
+        matches.push(this.fields[i])
+      }
+    }
+    return matches.length > 1 ? matches.reverse() : matches
+  }
+}
+
+// Options: key, or range [from, to] fields, prefix for added fields and budget in bytes
+async function buildIndex (records, options) {
+  const range = options.range
+  const index = range ? new RangeIndex() : new HashIndex()
+  const exclude = range || [options.key]
+  let size = 0
+  const add = (record) => {
+    size += recordSize(record)
+    if (size > options.budget) {
+      throw new Error(`Lookup table does not fit the join memory budget of ${Math.round(options.budget / 1048576)} MB`)
+    }
+    const fields = lookupFields(record, exclude, options.prefix)
+    if (range) {
+      index.add(record[range[0]], record[range[1]], fields)
+    } else if (!isMissing(record[options.key])) {
+      index.add(record[options.key], fields)
+    }
+  }
+  for await (const chunk of records) {
+    if (RecordBatch.isBatch(chunk)) {
+      chunk.toObjects().forEach(add)
+    } else {
+      add(chunk)
+    }
+  }
+  index.seal()
+  index.size = size
+  return index
+}
+
+// Built indexes by key, least recently used first
+const indexes = new Map()
+
+// open() returns the lookup record stream, only called when no index with this key is kept
+async function loadIndex (key, open, options) {
+  if (indexes.has(key)) {
+    const index = indexes.get(key)
+    indexes.delete(key)
+    indexes.set(key, index)
+    return index
+  }
+  const index = await buildIndex(open(), options)
+  indexes.set(key, index)
+  if (indexes.size > MAX_CACHED) {
+    indexes.delete(indexes.keys().next().value)
+  }
+  return index
+}
+
+module.exports = {
+  HashIndex,
+  RangeIndex,
+  buildIndex,
+  loadIndex
+}
@@ -0,0 +1,138 @@
+// Pipeline-wide memory accounting. Stages register the state they hold with a size estimate,
+// and spillable ones (aggregation tables, sort buffers) are asked to spill when they outgrow
+// their share of the limit, or when the heap nears the limit and theirs is the largest state.
+// Heap pressure only spills states worth a run of their own, and once per rise above the mark:
+// the next pressure spill waits until a fresh reading shows the heap back under it.
+// Spilling goes through spill.js, to OPFS where the platform has it.
+const DEFAULT_LIMIT = 1024 * 1024 * 1024
+const HIGH_WATER = 0.8 // share of the limit at which the largest spillable state is spilled
+const HEAP_SAMPLE_INTERVAL = 100 // ms between heap readings
+const MIN_SPILL_SHARE = 0.25 // of a stage's share of the limit, smaller states are not spilled on heap pressure
+const FIELD_SIZE = 16 // rough bytes per field besides string data
+
+const now = () => (typeof performance !== 'undefined' ? performance.now() : Date.now())
+
+// performance.memory is Chromium only, Node.js has process.memoryUsage()
+function readHeap () {
+  if (typeof performance !== 'undefined' && performance.memory) {
+    return performance.memory.usedJSHeapSize
+  }
+  if (typeof process !== 'undefined' && process.memoryUsage) {
+    return process.memoryUsage().heapUsed
+  }
+  return 0
+}
+
+function defaultLimit () {
+  if (typeof performance !== 'undefined' && performance.memory) {
+    return performance.memory.jsHeapSizeLimit / 2
+  }
+  return DEFAULT_LIMIT
+}
+
+// Rough bytes held by a plain record
+function recordSize (record) {
+  let size = 0
+  for (const name in record) {
+    const v = record[name]
+    size += FIELD_SIZE + (typeof v === 'string' ? v.length * 2 : 8)
+  }
+  return size
+}
+
+class Reservation {
+  constructor (manager, name, size, spillable) {
+    this.manager = manager
+    this.name = name
+    this.size = size
+    this.spillable = spillable
+  }
+
+  // Checked by the stage after adding to its state, it then calls its own spill()
+  get overBudget () {
+    return this.manager.shouldSpill(this)
+  }
+
+  release () {
+    this.manager.consumers.delete(this)
+  }
+
+  // Passes on an async iterator of the stage's results and releases once it is done
+  async * releaseAfter (iterator) {
+    try {
+      yield * iterator
+    } finally {
+      this.release()
+    }
+  }
+}
+
+class MemoryManager {
+  constructor (limit) {
+    this.limit = limit || defaultLimit()
+    this.consumers = new Set()
+    this.heap = 0
+    this.heapAt = -Infinity
+    this.pressure = false // a pressure spill was asked for and the heap has not dropped since
+  }
+
+  // size() estimates the bytes a stage holds, spillable stages check overBudget and spill on their own
+  register (name, size, spillable) {
+    const reservation = new Reservation(this, name, size, !!spillable)
+    this.consumers.add(reservation)
+    return reservation
+  }
+
+  heapUsed () {
+    if (now() - this.heapAt >= HEAP_SAMPLE_INTERVAL) {
+      this.heap = readHeap()
+      this.heapAt = now()
+    }
+    return this.heap
+  }
+
+  get tracked () {
+    let size = 0
+    this.consumers.forEach(r => { size += r.size() })
+    return size
+  }
+
+  shouldSpill (reservation) {
+    if (!reservation.spillable) return false
+    let spillable = 0
+    let largest = null
+    this.consumers.forEach(r => {
+      if (!r.spillable) return
+      spillable += 1
+      if (!largest || r.size() > largest.size()) largest = r
+    })
+    const size = reservation.size()
+    const share = this.limit / spillable
+    if (size > share) return true
+    if (largest !== reservation || size < share * MIN_SPILL_SHARE) return false
+    if (this.heapUsed() < this.limit * HIGH_WATER) {
+      this.pressure = false
+      return false
+    }
+    if (this.pressure) return false
+    // Freed state only shows once collected, the heap is read afresh on the next check
+    this.pressure = true
+    this.heapAt = -Infinity
+    return true
+  }
+
+  // Plain object for the UI, can be posted from a worker
+  usage () {
+    return {
+      heap: this.heapUsed(),
+      limit: this.limit,
+      tracked: this.tracked,
+      stages: Array.from(this.consumers, r => ({ name: r.name, size: r.size() }))
+    }
+  }
+}
+
+module.exports = {
+  recordSize,
+  MemoryManager
+}
@@ -0,0 +1,116 @@
+// Per-stage counters, collected by wrapping a stage stream's write, push and transform functions.
+// Text and bytes are counted in bytesIn/bytesOut, records and batch rows in recordsIn/recordsOut.
+// busy is the time between a transform call and its callback, blocked the time a stage waited
+// for the next one to drain after a write was refused.
+const { RecordBatch } = require('./batch')
+
+const now = () => (typeof performance !== 'undefined' ? performance.now() : Date.now())
+
+class StageMetrics {
+  constructor () {
+    this.bytesIn = 0
+    this.bytesOut = 0
+    this.recordsIn = 0
+    this.recordsOut = 0
+    this.busy = 0
+    this.blocked = 0
+    this.blockedAt = 0
+  }
+
+  count (chunk, output) {
+    let bytes = 0
+    let records = 0
+    if (typeof chunk === 'string') {
+      bytes = chunk.length
+    } else if (chunk instanceof Uint8Array) {
+      bytes = chunk.byteLength
+    } else if (RecordBatch.isBatch(chunk)) {
+      records = chunk.length
+    } else if (chunk !== null && typeof chunk !== 'undefined') {
+      records = 1
+    }
+    if (output) {
+      this.bytesOut += bytes
+      this.recordsOut += records
+    } else {
+      this.bytesIn += bytes
+      this.recordsIn += records
+    }
+  }
+
+  // Plain object that can be posted from a worker, an ongoing wait included
+  snapshot () {
+    return {
+      bytesIn: this.bytesIn,
+      bytesOut: this.bytesOut,
+      recordsIn: this.recordsIn,
+      recordsOut: this.recordsOut,
+      busy: this.busy,
+      blocked: this.blocked + (this.blockedAt ? now() - this.blockedAt : 0)
+    }
+  }
+}
+
+// Time from call to callback of a (chunk, enc, callback) or (callback) function
+function timed (fn, metrics) {
+  return function (...args) {
+    const callback = args.pop()
+    const start = now()
+    return fn.call(this, ...args, (...results) => {
+      metrics.busy += now() - start
+      callback(...results)
+    })
+  }
+}
+
+// upstream is the previous stage's metrics, charged with the time this stage holds it back
+function instrument (stream, metrics, upstream) {
+  const write = stream.write
+  stream.write = function (chunk, ...args) {
+    metrics.count(chunk, false)
+    const ok = write.call(this, chunk, ...args)
+    if (!ok && upstream && !upstream.blockedAt) {
+      upstream.blockedAt = now()
+    }
+    return ok
+  }
+  if (upstream) {
+    stream.on('drain', () => {
+      if (upstream.blockedAt) {
+        upstream.blocked += now() - upstream.blockedAt
+        upstream.blockedAt = 0
+      }
+    })
+  }
+  const push = stream.push
+  if (push) {
+    stream.push = function (chunk, ...args) {
+      metrics.count(chunk, true)
+      return push.call(this, chunk, ...args)
+    }
+  } else {
+    // Classic streams like JSONStream emit 'data' whether or not anyone listens
+    stream.on('data', chunk => metrics.count(chunk, true))
+  }
+  // Transform's own _write waits on the readable side too, so its _transform is timed instead
+  if (typeof stream._transform === 'function') {
+    stream._transform = timed(stream._transform, metrics)
+    if (typeof stream._flush === 'function') {
+      stream._flush = timed(stream._flush, metrics)
+    }
+  } else if (typeof stream._write === 'function') {
+    stream._write = timed(stream._write, metrics)
+  }
+  return stream
+}
+
+// [{id, metrics}] from build() to posted snapshots
+function snapshots (metrics) {
+  return metrics.map(m => ({ id: m.id, metrics: m.metrics.snapshot() }))
+}
+
+module.exports = {
+  StageMetrics,
+  instrument,
+  snapshots
+}
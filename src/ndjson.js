@@ -0,0 +1,57 @@
+// Newline-delimited JSON: every line is a standalone value parsed with native JSON.parse
+const through2 = require('through2')
+const { pick } = require('./rows')
+
+// Calls emit with the value of every non-blank line in text, projected to fields when given
+function parseLines (text, fields, emit) {
+  let start = 0
+  while (start < text.length) {
+    let end = text.indexOf('\n', start)
+    if (end === -1) end = text.length
+    const line = text.slice(start, end)
+    start = end + 1
+    if (!line.trim()) continue
+    let value
+    try {
+      value = JSON.parse(line)
+    } catch (err) {
+      throw new Error(`Invalid JSON line: ${line.slice(0, 80)}`)
+    }
+    emit(fields ? pick(value, fields) : value)
+  }
+}
+
+// Lines are split across chunk boundaries, bytes are decoded with a streaming TextDecoder
+function NDJSONStream (fields) {
+  const decoder = new TextDecoder()
+  let partial = ''
+  const push = (value) => stream.push(value)
+  const stream = through2.obj(function (chunk, enc, callback) {
+    const text = partial + (typeof chunk === 'string' ? chunk : decoder.decode(chunk, { stream: true }))
+    const end = text.lastIndexOf('\n')
+    if (end === -1) {
+      partial = text
+      return callback()
+    }
+    partial = text.slice(end + 1)
+    try {
+      parseLines(text.slice(0, end), fields, push)
+    } catch (err) {
+      return callback(err)
+    }
+    callback()
+  }, function (callback) {
+    try {
+      parseLines(partial + decoder.decode(), fields, push)
+    } catch (err) {
+      return callback(err)
+    }
+    callback()
+  })
+  return stream
+}
+
+module.exports = {
+  parseLines,
+  NDJSONStream
+}
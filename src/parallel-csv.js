@@ -0,0 +1,82 @@
+// Parallel CSV parsing: the header is read here, ranges after it are parsed in parse.worker
+const parse = require('csv-parse/lib/sync')
+const { readSlice, findBoundary, splitRanges, ParallelRangeStream } = require('./parallel')
+const { RowAssembler } = require('./rows')
+const { inferSchema } = require('./schema')
+
+const NEWLINE = 0x0A
+const SCAN_SIZE = 4 * 1024 * 1024
+const SAMPLE_SIZE = 1024 * 1024
+
+// Offset right after the header line and the parsed header
+async function readHeader (file, options) {
+  const state = { inQuotes: false }
+  let offset = 0
+  while (offset < file.size) {
+    const buf = await readSlice(file, 0, offset + SCAN_SIZE)
+    const nl = findBoundary(buf, 0, state)
+    if (nl !== -1) {
+      return { end: nl + 1, columns: parse(buf.slice(0, nl + 1), options)[0] }
+    }
+    offset = buf.length
+    state.inQuotes = false
+  }
+  return { end: file.size, columns: parse(await readSlice(file, 0, file.size), options)[0] || [] }
+}
+
+// First `count` value arrays after the header, for schema inference before the ranges are handed out
+async function readSample (file, start, options, count) {
+  const buf = await readSlice(file, start, start + SAMPLE_SIZE)
+  const end = start + buf.length < file.size ? buf.lastIndexOf(NEWLINE) + 1 : buf.length
+  try {
+    return parse(buf.slice(0, end), options).slice(0, count)
+  } catch (err) {
+    return []
+  }
+}
+
+// Parses line-aligned byte ranges of a CSV file in a worker pool and emits records in file order
+class ParallelCSVStream extends ParallelRangeStream {
+  constructor (file, options, settings) {
+    super(file, settings)
+    this.options = options
+    this.columns = null
+  }
+
+  async _prepare () {
+    const headerOptions = Object.assign({}, this.options, { columns: false })
+    const header = await readHeader(this.file, headerOptions)
+    // Batches and filtered rows are assembled in the workers from value arrays, plain objects by csv-parse itself
+    const rows = this.settings.rows
+    this.columns = header.columns
+    this.options = rows.batchSize || rows.filter || rows.fields || rows.sample || this.settings.engine === 'Fast'
+      ? Object.assign({}, this.options, { columns: false, cast: false })
+      : Object.assign({}, this.options, { columns: header.columns })
+    // Every worker gets the same schema, inferred here from the start of the file
+    if (rows.sample) {
+      const sample = await readSample(this.file, header.end, this.options, rows.sample)
+      const schema = inferSchema(header.columns, sample, new RowAssembler(header.columns, rows).castIndices)
+      this.settings.rows = Object.assign({}, rows, { schema, sample: 0 })
+      this.emit('metadata', { schema })
+    }
+    return header.end
+  }
+
+  _message (start, end) {
+    return {
+      kind: 'csv',
+      file: this.file,
+      start,
+      end,
+      options: this.options,
+      engine: this.settings.engine,
+      columns: this.columns,
+      rows: this.settings.rows
+    }
+  }
+}
+
+module.exports = {
+  splitRanges,
+  ParallelCSVStream
+}
@@ -0,0 +1,27 @@
+// Parallel NDJSON parsing: lines never span newlines, so ranges only need to end on one
+const { ParallelRangeStream } = require('./parallel')
+
+class ParallelNDJSONStream extends ParallelRangeStream {
+  constructor (file, fields, settings) {
+    super(file, Object.assign({}, settings, { quotedNewlines: false }))
+    this.fields = fields
+  }
+
+  async _prepare () {
+    return 0
+  }
+
+  _message (start, end) {
+    return {
+      kind: 'ndjson',
+      file: this.file,
+      start,
+      end,
+      fields: this.fields
+    }
+  }
+}
+
+module.exports = {
+  ParallelNDJSONStream
+}
@@ -0,0 +1,170 @@
+// Worker-pool parsing of line-aligned byte ranges of a file, results emitted in file order
+const { Readable } = require('stream')
+const { WorkerPool } = require('./worker-pool')
+const { RecordBatch } = require('./batch')
+
+const QUOTE = 0x22
+const NEWLINE = 0x0A
+const SCAN_SIZE = 4 * 1024 * 1024
+
+async function readSlice (file, start, end) {
+  return Buffer.from(await file.slice(start, end).arrayBuffer())
+}
+
+// Flip quote state for every quote in buf[from, to)
+function skipQuotes (buf, from, to, inQuotes) {
+  let q = buf.indexOf(QUOTE, from)
+  while (q !== -1 && q < to) {
+    inQuotes = !inQuotes
+    q = buf.indexOf(QUOTE, q + 1)
+  }
+  return inQuotes
+}
+
+// First newline at or after `from` that is outside quotes, -1 if none in buf
+function findBoundary (buf, from, state) {
+  let i = from
+  while (i < buf.length) {
+    const q = buf.indexOf(QUOTE, i)
+    if (state.inQuotes) {
+      if (q === -1) return -1
+      state.inQuotes = false
+      i = q + 1
+    } else {
+      const nl = buf.indexOf(NEWLINE, i)
+      if (nl !== -1 && (q === -1 || nl < q)) return nl
+      if (q === -1) return -1
+      state.inQuotes = true
+      i = q + 1
+    }
+  }
+  return -1
+}
+
+// Split [start, file.size) into ranges of about rangeSize bytes ending on line boundaries.
+// With quoted newlines every byte has to be scanned to track quote state,
+// without them it's enough to look for the next newline after each target offset.
+async function * splitRanges (file, start, rangeSize, quotedNewlines) {
+  const state = { inQuotes: false }
+  let rangeStart = start
+  let target = start + rangeSize
+  let offset = quotedNewlines ? start : target
+  while (target < file.size) {
+    const buf = await readSlice(file, offset, offset + SCAN_SIZE)
+    if (!buf.length) break
+    let from = 0
+    if (target > offset) {
+      from = Math.min(target - offset, buf.length)
+      state.inQuotes = skipQuotes(buf, 0, from, state.inQuotes)
+    }
+    const nl = quotedNewlines ? findBoundary(buf, from, state) : buf.indexOf(NEWLINE, from)
+    if (nl === -1) {
+      offset += buf.length
+      continue
+    }
+    yield [rangeStart, offset + nl + 1]
+    rangeStart = offset + nl + 1
+    target = rangeStart + rangeSize
+    if (quotedNewlines) {
+      state.inQuotes = skipQuotes(buf, nl + 1, Math.min(buf.length, target - offset), state.inQuotes)
+      offset += Math.min(buf.length, target - offset)
+    } else {
+      offset = target
+    }
+  }
+  if (rangeStart < file.size) {
+    yield [rangeStart, file.size]
+  }
+}
+
+// Subclasses implement _prepare(), resolving to the offset where ranges start,
+// and _message(start, end) with the parse.worker task for one range.
+// Settings: workers, rangeSize, quotedNewlines
+class ParallelRangeStream extends Readable {
+  constructor (file, settings) {
+    super({ objectMode: true })
+    this.file = file
+    this.settings = settings
+    this.emitsProgress = true
+    this.pool = null
+    this.pending = []
+    this.ranges = null
+    this.rangesDone = false
+    this.reading = false
+    this.wantMore = false
+    this.loaded = 0
+  }
+
+  async _init () {
+    const start = await this._prepare()
+    this.loaded = start
+    this.ranges = splitRanges(this.file, start, this.settings.rangeSize, this.settings.quotedNewlines)
+    const PoolWorker = require('./parse.worker.js').default
+    this.pool = new WorkerPool(() => new PoolWorker(), this.settings.workers)
+  }
+
+  // Keep every worker busy plus one queued range each
+  async _fill () {
+    while (!this.rangesDone && this.pending.length < this.pool.size * 2) {
+      const next = await this.ranges.next()
+      if (next.done) {
+        this.rangesDone = true
+        break
+      }
+      const [start, end] = next.value
+      const task = this.pool.run(this._message(start, end))
+      task.catch(() => {})
+      this.pending.push({ task, size: end - start })
+    }
+  }
+
+  async _pump () {
+    if (!this.pool) await this._init()
+    while (true) {
+      await this._fill()
+      if (!this.pending.length) {
+        this.pool.terminate()
+        this.push(null)
+        return
+      }
+      const { task, size } = this.pending.shift()
+      const records = await task
+      this.loaded += size
+      this.emit('progress', this.loaded, this.file.size)
+      let more = true
+      for (const record of records) {
+        more = this.push(RecordBatch.revive(record))
+      }
+      if (!more) return
+    }
+  }
+
+  _read () {
+    if (this.reading) {
+      this.wantMore = true
+      return
+    }
+    this.reading = true
+    this._pump()
+      .catch(err => this.destroy(err))
+      .then(() => {
+        this.reading = false
+        if (this.wantMore) {
+          this.wantMore = false
+          this._read()
+        }
+      })
+  }
+
+  _destroy (err, callback) {
+    if (this.pool) this.pool.terminate()
+    callback(err)
+  }
+}
+
+module.exports = {
+  readSlice,
+  findBoundary,
+  splitRanges,
+  ParallelRangeStream
+}
@@ -0,0 +1,665 @@
+// Parquet files as record batches. Flat schemas only; byte arrays are read as UTF-8 text, every other
+// type as numbers (dates and timestamps in ms, decimals scaled). Only the column chunks of the fields
+// read are fetched, and row groups whose min/max statistics rule out a pushed-down filter are skipped.
+// Pages may be PLAIN or dictionary encoded, v1 or v2, uncompressed, Snappy or gzip.
+// Files are written with one dictionary-encoded page per text column and PLAIN doubles for numbers.
+const { NUMBER, STRING, Column, RecordBatch } = require('./batch')
+const { CompactReader, T, I32, BINARY, STRUCT, encodeStruct } = require('./thrift')
+const { uncompress } = require('./snappy')
+const { expressionFields, compileBatchFilter, comparisons } = require('./expr')
+const { concatBytes, split, BatchPacker, schemaOf, conform } = require('./columnar')
+
+const MAGIC = [0x50, 0x41, 0x52, 0x31] // PAR1
+const ROW_GROUP_SIZE = 65536 // rows per written row group
+const TWO_32 = 4294967296
+const JULIAN_EPOCH = 2440588 // Julian day of 1970-01-01
+
+// Physical types
+const BOOLEAN = 0
+const INT32 = 1
+const INT64 = 2
+const INT96 = 3
+const FLOAT = 4
+const DOUBLE = 5
+const BYTE_ARRAY = 6
+const TYPE_NAMES = ['BOOLEAN', 'INT32', 'INT64', 'INT96', 'FLOAT', 'DOUBLE', 'BYTE_ARRAY', 'FIXED_LEN_BYTE_ARRAY']
+
+// Converted types
+const UTF8 = 0
+const DECIMAL = 5
+const DATE = 6
+const TIMESTAMP_MICROS = 10
+const UINT_32 = 13
+const UINT_64 = 14
+
+const OPTIONAL = 1
+const REPEATED = 2
+
+// Encodings, page types and codecs
+const PLAIN = 0
+const PLAIN_DICTIONARY = 2
+const RLE = 3
+const RLE_DICTIONARY = 8
+const DATA_PAGE = 0
+const DICTIONARY_PAGE = 2
+const DATA_PAGE_V2 = 3
+const CODECS = ['UNCOMPRESSED', 'SNAPPY', 'GZIP', 'LZO', 'BROTLI', 'LZ4', 'ZSTD', 'LZ4_RAW']
+
+const decoder = new TextDecoder()
+const encoder = new TextEncoder()
+
+// Multiplier to ms for dates and timestamps, 10^-scale for decimals
+function valueScale (element) {
+  const logical = element[10]
+  if (logical && logical[8]) {
+    const unit = logical[8][2] || {}
+    return unit[2] ? 1e-3 : unit[3] ? 1e-6 : 1
+  }
+  if ((logical && logical[6]) || element[6] === DATE) return 86400000
+  if (logical && logical[5]) return Math.pow(10, -(logical[5][1] || 0))
+  if (element[6] === TIMESTAMP_MICROS) return 1e-3
+  if (element[6] === DECIMAL) return Math.pow(10, -(element[7] || 0))
+  return 1
+}
+
+// Leaf columns: {name, index, physical, optional, type, scale, unsigned}
+function readSchema (elements) {
+  return elements.slice(1).map((element, index) => {
+    const name = decoder.decode(element[4])
+    if (element[5]) {
+      throw new Error(`Nested Parquet column ${name} is not supported`)
+    }
+    if (element[3] === REPEATED) {
+      throw new Error(`Repeated Parquet column ${name} is not supported`)
+    }
+    const integer = element[10] && element[10][10]
+    return {
+      name,
+      index,
+      physical: element[1],
+      optional: element[3] === OPTIONAL,
+      type: element[1] === BYTE_ARRAY ? STRING : NUMBER,
+      scale: valueScale(element),
+      unsigned: element[6] === UINT_32 || element[6] === UINT_64 || (!!integer && integer[2] === false)
+    }
+  })
+}
+
+// RLE/bit-packed hybrid runs of `width`-bit values, count of them into an Int32Array
+function readHybrid (bytes, pos, end, width, count) {
+  const out = new Int32Array(count)
+  const byteWidth = (width + 7) >> 3
+  const mask = width === 32 ? -1 : (1 << width) - 1
+  let i = 0
+  while (i < count && pos < end) {
+    let header = 0
+    let shift = 0
+    let b
+    do {
+      b = bytes[pos++]
+      header += (b & 0x7f) * Math.pow(2, shift)
+      shift += 7
+    } while (b & 0x80)
+    if (header % 2) {
+      const n = Math.floor(header / 2) * 8
+      for (let j = 0; j < n && i < count; j++, i++) {
+        const bit = j * width
+        const p = pos + (bit >> 3)
+        if (width <= 24) {
+          const word = bytes[p] | (bytes[p + 1] << 8) | (bytes[p + 2] << 16) | (bytes[p + 3] << 24)
+          out[i] = (word >>> (bit & 7)) & mask
+        } else {
+          let v = 0
+          for (let k = 0; k < width; k++) {
+            const q = bit + k
+            v |= ((bytes[pos + (q >> 3)] >> (q & 7)) & 1) << k
+          }
+          out[i] = v
+        }
+      }
+      pos += Math.floor(header / 2) * width
+    } else {
+      let value = 0
+      for (let k = 0; k < byteWidth; k++) value |= bytes[pos + k] << (8 * k)
+      pos += byteWidth
+      const n = Math.min(count - i, Math.floor(header / 2))
+      out.fill(value, i, i + n)
+      i += n
+    }
+  }
+  return out
+}
+
+function readByteArrays (bytes, count) {
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+  const strings = new Array(count)
+  let pos = 0
+  for (let i = 0; i < count; i++) {
+    const length = view.getInt32(pos, true)
+    strings[i] = decoder.decode(bytes.subarray(pos + 4, pos + 4 + length))
+    pos += 4 + length
+  }
+  return strings
+}
+
+// PLAIN numbers of a physical type, before scaling
+function readNumbers (column, bytes, count) {
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+  const values = new Float64Array(count)
+  switch (column.physical) {
+    case BOOLEAN:
+      for (let i = 0; i < count; i++) values[i] = (bytes[i >> 3] >> (i & 7)) & 1
+      return values
+    case INT32:
+      for (let i = 0; i < count; i++) values[i] = column.unsigned ? view.getUint32(4 * i, true) : view.getInt32(4 * i, true)
+      return values
+    case INT64:
+      for (let i = 0; i < count; i++) {
+        const hi = column.unsigned ? view.getUint32(8 * i + 4, true) : view.getInt32(8 * i + 4, true)
+        values[i] = view.getUint32(8 * i, true) + hi * TWO_32
+      }
+      return values
+    case INT96:
+      // Nanoseconds in the day, then the Julian day
+      for (let i = 0; i < count; i++) {
+        const nanos = view.getUint32(12 * i, true) + view.getUint32(12 * i + 4, true) * TWO_32
+        values[i] = (view.getInt32(12 * i + 8, true) - JULIAN_EPOCH) * 86400000 + nanos / 1e6
+      }
+      return values
+    case FLOAT:
+      for (let i = 0; i < count; i++) values[i] = view.getFloat32(4 * i, true)
+      return values
+    case DOUBLE:
+      for (let i = 0; i < count; i++) values[i] = view.getFloat64(8 * i, true)
+      return values
+  }
+  throw new Error(`Parquet type ${TYPE_NAMES[column.physical]} of column ${column.name} is not supported`)
+}
+
+function scaled (column, values) {
+  if (column.scale !== 1) {
+    for (let i = 0; i < values.length; i++) values[i] *= column.scale
+  }
+  return values
+}
+
+async function gunzip (bytes) {
+  if (typeof DecompressionStream === 'undefined') {
+    throw new Error('Gzip needs DecompressionStream, which this browser does not support')
+  }
+  const stream = new Blob([bytes]).stream().pipeThrough(new DecompressionStream('gzip'))
+  return new Uint8Array(await new Response(stream).arrayBuffer())
+}
+
+async function decompress (bytes, codec) {
+  switch (codec) {
+    case 0: return bytes
+    case 1: return uncompress(bytes)
+    case 2: return gunzip(bytes)
+  }
+  throw new Error(`Parquet codec ${CODECS[codec] || codec} is not supported`)
+}
+
+// Values of one column chunk, page by page, into a batch column of the row group's length.
+// Text keeps the chunk's dictionary as the batch dictionary, so dictionary indices are batch codes.
+class ChunkDecoder {
+  constructor (column, rows) {
+    this.column = column
+    this.values = column.type === STRING ? new Int32Array(rows).fill(-1) : new Float64Array(rows).fill(NaN)
+    this.row = 0
+    this.dictionary = null
+    this.strings = []
+    this.index = null
+  }
+
+  code (s) {
+    if (!this.index) {
+      this.index = new Map()
+      this.strings.forEach((v, i) => this.index.set(v, i))
+    }
+    let code = this.index.get(s)
+    if (typeof code === 'undefined') {
+      code = this.strings.length
+      this.strings.push(s)
+      this.index.set(s, code)
+    }
+    return code
+  }
+
+  dictionaryPage (bytes, count) {
+    if (this.column.type === STRING) {
+      const strings = readByteArrays(bytes, count)
+      if (!this.strings.length) {
+        this.strings = strings
+        this.dictionary = null
+      } else {
+        this.dictionary = Int32Array.from(strings, s => this.code(s))
+      }
+      return
+    }
+    this.dictionary = scaled(this.column, readNumbers(this.column, bytes, count))
+  }
+
+  // Non-null values of a page, count of them
+  decode (bytes, encoding, count) {
+    const text = this.column.type === STRING
+    if (encoding === PLAIN) {
+      return text
+        ? Int32Array.from(readByteArrays(bytes, count), s => this.code(s))
+        : scaled(this.column, readNumbers(this.column, bytes, count))
+    }
+    if (encoding === PLAIN_DICTIONARY || encoding === RLE_DICTIONARY) {
+      const indices = readHybrid(bytes, 1, bytes.length, bytes[0], count)
+      if (text) {
+        return this.dictionary ? indices.map(i => this.dictionary[i]) : indices
+      }
+      return Float64Array.from(indices, i => this.dictionary[i])
+    }
+    if (encoding === RLE && this.column.physical === BOOLEAN) {
+      return Float64Array.from(readHybrid(bytes, 4, bytes.length, 1, count))
+    }
+    throw new Error(`Parquet encoding ${encoding} of column ${this.column.name} is not supported`)
+  }
+
+  // defs: definition levels of the page's n slots, null for required columns
+  dataPage (bytes, encoding, n, defs) {
+    let count = n
+    if (defs) {
+      count = 0
+      for (let i = 0; i < n; i++) count += defs[i]
+    }
+    const decoded = this.decode(bytes, encoding, count)
+    if (!defs) {
+      this.values.set(decoded.subarray(0, n), this.row)
+    } else {
+      for (let i = 0, k = 0; i < n; i++) {
+        if (defs[i]) this.values[this.row + i] = decoded[k++]
+      }
+    }
+    this.row += n
+  }
+
+  finish () {
+    return new Column(this.column.name, this.column.type, this.values, this.column.type === STRING ? this.strings : null)
+  }
+}
+
+async function decodeChunk (column, meta, bytes, rows) {
+  const chunk = new ChunkDecoder(column, rows)
+  const codec = meta[4]
+  let pos = 0
+  while (chunk.row < rows && pos < bytes.length) {
+    const reader = new CompactReader(bytes, pos)
+    const header = reader.struct()
+    const page = bytes.subarray(reader.pos, reader.pos + header[3])
+    pos = reader.pos + header[3]
+    if (header[1] === DICTIONARY_PAGE) {
+      chunk.dictionaryPage(await decompress(page, codec), header[7][1])
+    } else if (header[1] === DATA_PAGE) {
+      const data = await decompress(page, codec)
+      const h = header[5]
+      let defs = null
+      let start = 0
+      if (column.optional) {
+        if (h[3] !== RLE) {
+          throw new Error(`Bit-packed definition levels of column ${column.name} are not supported`)
+        }
+        const length = new DataView(data.buffer, data.byteOffset, 4).getInt32(0, true)
+        defs = readHybrid(data, 4, 4 + length, 1, h[1])
+        start = 4 + length
+      }
+      chunk.dataPage(data.subarray(start), h[2], h[1], defs)
+    } else if (header[1] === DATA_PAGE_V2) {
+      // Levels are never compressed in v2 pages, and values only when is_compressed is set
+      const h = header[8]
+      const levels = (h[6] || 0) + (h[5] || 0)
+      const defs = column.optional ? readHybrid(page, h[6] || 0, levels, 1, h[1]) : null
+      const body = page.subarray(levels)
+      chunk.dataPage(h[7] === false ? body : await decompress(body, codec), h[4], h[1], defs)
+    }
+  }
+  return chunk.finish()
+}
+
+// Byte range of a column chunk, dictionary page included
+function chunkRange (meta) {
+  const start = meta[11] > 0 ? Math.min(meta[11], meta[9]) : meta[9]
+  return [start, start + meta[7]]
+}
+
+function statValue (column, bytes) {
+  if (!bytes) return null
+  if (column.type === STRING) return decoder.decode(bytes)
+  if (column.physical === BOOLEAN) return null
+  const values = readNumbers(column, bytes, 1)
+  return values[0] * column.scale
+}
+
+// {min, max} from a chunk's statistics, null when missing. The legacy min and max fields
+// were compared as signed bytes, they are only trusted for signed numbers.
+function chunkStats (column, meta) {
+  const stats = meta[12]
+  if (!stats) return null
+  const legacy = column.type === NUMBER && !column.unsigned
+  const min = statValue(column, stats[6] || (legacy ? stats[2] : null))
+  const max = statValue(column, stats[5] || (legacy ? stats[1] : null))
+  return min === null || max === null ? null : { min, max }
+}
+
+// Whether no row of a chunk can satisfy field op value, text only settles equality
+function excludes (comparison, stats) {
+  const { op, value } = comparison
+  if (!stats || typeof value !== typeof stats.min) return false
+  switch (op) {
+    case '==': return value < stats.min || value > stats.max
+    case '<': return typeof value === 'number' && stats.min >= value
+    case '<=': return typeof value === 'number' && stats.min > value
+    case '>': return typeof value === 'number' && stats.max <= value
+    case '>=': return typeof value === 'number' && stats.max < value
+  }
+  return false
+}
+
+class ParquetReader {
+  constructor (source, options) {
+    this.source = source
+    this.fields = options.fields || null
+    this.filter = options.filter || null
+  }
+
+  async open () {
+    const { source } = this
+    const tail = await source.read(Math.max(0, source.size - 8), source.size)
+    if (source.size < 12 || !MAGIC.every((b, i) => tail[4 + i] === b)) {
+      throw new Error('Not a Parquet file')
+    }
+    const length = new DataView(tail.buffer, tail.byteOffset, 4).getInt32(0, true)
+    const meta = new CompactReader(await source.read(source.size - 8 - length, source.size - 8)).struct()
+    this.columns = readSchema(meta[2])
+    this.rowGroups = meta[4] || []
+  }
+
+  async * batches (emitMetadata, batchSize) {
+    await this.open()
+    const outputs = this.fields ? this.columns.filter(c => this.fields.includes(c.name)) : this.columns
+    const filterFields = this.filter ? expressionFields(this.filter) : []
+    const read = this.columns.filter(c => outputs.includes(c) || filterFields.includes(c.name))
+    const tests = this.filter ? comparisons(this.filter) : []
+    const test = this.filter ? compileBatchFilter(this.filter) : null
+    const schema = outputs.map(c => ({ name: c.name, type: c.type }))
+    emitMetadata({ schema })
+
+    let skipped = 0
+    for (const group of this.rowGroups) {
+      const rows = group[3]
+      const chunks = group[1].map(chunk => chunk[3])
+      const loaded = Math.max(...chunks.map(meta => chunkRange(meta)[1]))
+      const excluded = tests.some(t => {
+        const column = read.find(c => c.name === t.field)
+        return column && excludes(t, chunkStats(column, chunks[column.index]))
+      })
+      if (excluded) {
+        skipped += 1
+        yield { batches: [], loaded }
+        continue
+      }
+      const columns = await Promise.all(read.map(async column => {
+        const meta = chunks[column.index]
+        const [start, end] = chunkRange(meta)
+        return decodeChunk(column, meta, await this.source.read(start, end), rows)
+      }))
+      let batch = new RecordBatch(columns, rows)
+      if (test) {
+        const [selection, n] = test(batch)
+        if (n < rows) batch = batch.select(selection, n)
+      }
+      if (read.length > outputs.length) {
+        batch = batch.project(outputs.map(c => c.name))
+      }
+      yield { batches: batch.length ? split(batch, batchSize) : [], loaded }
+    }
+    emitMetadata({ schema, rowGroups: { total: this.rowGroups.length, skipped } })
+  }
+}
+
+// Async iterator of {batches, loaded} for columnarStream(). Options: fields, filter, batchSize
+function readParquet (source, emitMetadata, options) {
+  return new ParquetReader(source, options).batches(emitMetadata, options.batchSize)
+}
+
+function varint (n) {
+  const bytes = []
+  while (n >= 0x80) {
+    bytes.push((n % 128) | 0x80)
+    n = Math.floor(n / 128)
+  }
+  bytes.push(n)
+  return bytes
+}
+
+// One bit-packed run of the hybrid encoding, padded to a multiple of 8 values
+function bitPack (values, count, width) {
+  const groups = Math.ceil(count / 8)
+  const header = varint(groups * 2 + 1)
+  const out = new Uint8Array(header.length + groups * width)
+  out.set(header)
+  for (let i = 0, bit = header.length * 8; i < count; i++) {
+    const v = values[i]
+    for (let k = 0; k < width; k++, bit++) {
+      if ((v >> k) & 1) out[bit >> 3] |= 1 << (bit & 7)
+    }
+  }
+  return out
+}
+
+function int32Bytes (n) {
+  const bytes = new Uint8Array(4)
+  new DataView(bytes.buffer).setInt32(0, n, true)
+  return bytes
+}
+
+function compareBytes (a, b) {
+  const n = Math.min(a.length, b.length)
+  for (let i = 0; i < n; i++) {
+    if (a[i] !== b[i]) return a[i] - b[i]
+  }
+  return a.length - b.length
+}
+
+// Page header and body, uncompressed
+function page (type, body, headerField, header) {
+  return concatBytes([encodeStruct({
+    1: T.i32(type),
+    2: T.i32(body.length),
+    3: T.i32(body.length),
+    [headerField]: T.struct(header)
+  }), body])
+}
+
+// Definition levels with their length, all columns are written optional
+function levels (defs, count) {
+  const packed = bitPack(defs, count, 1)
+  return [int32Bytes(packed.length), packed]
+}
+
+// Chunk bytes and ColumnMetaData of a numeric column, doubles
+function numberChunk (field, parts, rows, offset) {
+  const defs = new Uint8Array(rows)
+  const data = new Float64Array(rows)
+  let min = Infinity
+  let max = -Infinity
+  let n = 0
+  let row = 0
+  parts.forEach(({ values }) => {
+    for (let i = 0; i < values.length; i++, row++) {
+      const v = values[i]
+      if (v !== v) continue
+      defs[row] = 1
+      data[n++] = v
+      if (v < min) min = v
+      if (v > max) max = v
+    }
+  })
+  const body = concatBytes(levels(defs, rows).concat([new Uint8Array(data.buffer, 0, n * 8)]))
+  const bytes = page(DATA_PAGE, body, 5, { 1: T.i32(rows), 2: T.i32(PLAIN), 3: T.i32(RLE), 4: T.i32(RLE) })
+  const stats = { 3: T.i64(rows - n) }
+  if (n) {
+    stats[5] = T.binary(new Uint8Array(Float64Array.of(max).buffer))
+    stats[6] = T.binary(new Uint8Array(Float64Array.of(min).buffer))
+  }
+  return {
+    bytes,
+    meta: {
+      1: T.i32(DOUBLE),
+      2: T.list(I32, [PLAIN, RLE]),
+      3: T.list(BINARY, [encoder.encode(field.name)]),
+      4: T.i32(0),
+      5: T.i64(rows),
+      6: T.i64(bytes.length),
+      7: T.i64(bytes.length),
+      9: T.i64(offset),
+      12: T.struct(stats)
+    }
+  }
+}
+
+// Chunk bytes and ColumnMetaData of a text column: the batch dictionaries merged into one dictionary page
+function stringChunk (field, parts, rows, offset) {
+  const defs = new Uint8Array(rows)
+  const indices = new Int32Array(rows)
+  const dictionary = []
+  const index = new Map()
+  let n = 0
+  let row = 0
+  parts.forEach(({ codes, dictionary: strings }) => {
+    const remap = new Int32Array(strings.length).fill(-1)
+    for (let i = 0; i < codes.length; i++, row++) {
+      const c = codes[i]
+      if (c === -1) continue
+      if (remap[c] === -1) {
+        const s = strings[c]
+        if (!index.has(s)) {
+          index.set(s, dictionary.length)
+          dictionary.push(s)
+        }
+        remap[c] = index.get(s)
+      }
+      defs[row] = 1
+      indices[n++] = remap[c]
+    }
+  })
+  const encoded = dictionary.map(s => encoder.encode(s))
+  const dictionaryPage = page(DICTIONARY_PAGE, concatBytes([].concat(...encoded.map(b => [int32Bytes(b.length), b]))), 7, {
+    1: T.i32(dictionary.length),
+    2: T.i32(PLAIN_DICTIONARY)
+  })
+  const width = dictionary.length > 1 ? 32 - Math.clz32(dictionary.length - 1) : 1
+  const body = concatBytes(levels(defs, rows).concat([Uint8Array.of(width), bitPack(indices, n, width)]))
+  const dataPage = page(DATA_PAGE, body, 5, { 1: T.i32(rows), 2: T.i32(PLAIN_DICTIONARY), 3: T.i32(RLE), 4: T.i32(RLE) })
+  const bytes = concatBytes([dictionaryPage, dataPage])
+  const stats = { 3: T.i64(rows - n) }
+  if (encoded.length) {
+    const sorted = encoded.slice().sort(compareBytes)
+    stats[5] = T.binary(sorted[sorted.length - 1])
+    stats[6] = T.binary(sorted[0])
+  }
+  return {
+    bytes,
+    meta: {
+      1: T.i32(BYTE_ARRAY),
+      2: T.list(I32, [PLAIN_DICTIONARY, RLE]),
+      3: T.list(BINARY, [encoder.encode(field.name)]),
+      4: T.i32(0),
+      5: T.i64(rows),
+      6: T.i64(bytes.length),
+      7: T.i64(bytes.length),
+      9: T.i64(offset + dictionaryPage.length),
+      11: T.i64(offset),
+      12: T.struct(stats)
+    }
+  }
+}
+
+// FileOutput serializer: batches are held until a row group is full, then written column by column
+class ParquetSerializer {
+  constructor (rowGroupSize) {
+    this.binary = true
+    this.rowGroupSize = rowGroupSize || ROW_GROUP_SIZE
+    this.packer = new BatchPacker()
+    this.schema = null
+    this.batches = []
+    this.rows = 0
+    this.totalRows = 0
+    this.offset = 0
+    this.rowGroups = []
+  }
+
+  // The first row group decides the column types
+  rowGroup () {
+    if (!this.schema) this.schema = schemaOf(this.batches)
+    const parts = []
+    const columns = []
+    const start = this.offset
+    this.schema.forEach(field => {
+      const values = this.batches.map(batch => conform(batch, field))
+      const chunk = (field.type === NUMBER ? numberChunk : stringChunk)(field, values, this.rows, this.offset)
+      parts.push(chunk.bytes)
+      columns.push(T.struct({ 2: T.i64(this.offset), 3: T.struct(chunk.meta) }))
+      this.offset += chunk.bytes.length
+    })
+    this.rowGroups.push(T.struct({
+      1: T.list(STRUCT, columns),
+      2: T.i64(this.offset - start),
+      3: T.i64(this.rows)
+    }))
+    this.totalRows += this.rows
+    this.batches = []
+    this.rows = 0
+    return concatBytes(parts)
+  }
+
+  // Batches are kept past this call, pooled ones as views of their own
+  write (batches) {
+    const parts = []
+    batches.forEach(batch => {
+      if (!this.offset) {
+        parts.push(Uint8Array.from(MAGIC))
+        this.offset = MAGIC.length
+      }
+      this.batches.push(RecordBatch.keep(batch))
+      this.rows += batch.length
+      if (this.rows >= this.rowGroupSize) parts.push(this.rowGroup())
+    })
+    return concatBytes(parts)
+  }
+
+  serialize (chunk) {
+    return this.write(this.packer.add(chunk))
+  }
+
+  end () {
+    const parts = [this.write(this.packer.end())]
+    if (this.rows) parts.push(this.rowGroup())
+    if (!this.offset) parts.push(Uint8Array.from(MAGIC))
+    if (!this.schema) this.schema = []
+    const elements = [T.struct({ 4: T.string('schema'), 5: T.i32(this.schema.length) })].concat(this.schema.map(field => {
+      const element = { 1: T.i32(field.type === NUMBER ? DOUBLE : BYTE_ARRAY), 3: T.i32(OPTIONAL), 4: T.string(field.name) }
+      if (field.type === STRING) element[6] = T.i32(UTF8)
+      return T.struct(element)
+    }))
+    const meta = encodeStruct({
+      1: T.i32(1),
+      2: T.list(STRUCT, elements),
+      3: T.i64(this.totalRows),
+      4: T.list(STRUCT, this.rowGroups),
+      6: T.string('tranfi')
+    })
+    parts.push(meta, int32Bytes(meta.length), Uint8Array.from(MAGIC))
+    return concatBytes(parts)
+  }
+}
+
+module.exports = {
+  readParquet,
+  ParquetSerializer
+}
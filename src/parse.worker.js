@@ -0,0 +1,53 @@
+// Parses byte ranges of a file for the parallel parser streams
+const parse = require('csv-parse/lib/sync')
+const { RecordBatch } = require('./batch')
+const { RowAssembler } = require('./rows')
+const { CSVTokenizer } = require('./tokenizer')
+const { parseLines } = require('./ndjson')
+
+function tokenize (bytes, message) {
+  const output = []
+  const push = (chunk) => output.push(chunk)
+  const assembler = new RowAssembler(message.columns, message.rows)
+  const tokenizer = CSVTokenizer.fromParseOptions(message.options)
+  tokenizer.columns(assembler.castIndices)
+  const write = (values) => assembler.write(values, push)
+  tokenizer.write(bytes, write)
+  tokenizer.end(write)
+  assembler.end(push)
+  return output
+}
+
+const parsers = {
+  csv: async function (message) {
+    const buffer = await message.file.slice(message.start, message.end).arrayBuffer()
+    if (message.engine === 'Fast') {
+      return tokenize(new Uint8Array(buffer), message)
+    }
+    const records = parse(Buffer.from(buffer), message.options)
+    if (message.options.columns !== false) {
+      return records
+    }
+    const output = []
+    const push = (chunk) => output.push(chunk)
+    const assembler = new RowAssembler(message.columns, message.rows)
+    for (const values of records) {
+      assembler.write(values, push)
+    }
+    assembler.end(push)
+    return output
+  },
+  ndjson: async function (message) {
+    const buffer = await message.file.slice(message.start, message.end).arrayBuffer()
+    const output = []
+    parseLines(new TextDecoder().decode(buffer), message.fields, (value) => output.push(value))
+    return output
+  }
+}
+
+self.onmessage = function (e) {
+  const message = e.data
+  parsers[message.kind](message)
+    .then(result => self.postMessage({ id: message.id, result }, RecordBatch.transferables(result)))
+    .catch(err => self.postMessage({ id: message.id, error: err.message }))
+}
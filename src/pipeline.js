@@ -0,0 +1,384 @@
+const through2 = require('through2')
+const transforms = require('./transforms')
+const { countRecords, gate, tee } = require('./streams')
+const { StageMetrics, instrument } = require('./metrics')
+const { stageKeys } = require('./cache')
+const { MemoryManager } = require('./memory')
+
+const PIPELINE_VERSION = 1
+
+// Value a fresh card starts with
+function defaultValue (input) {
+  if (input.default) {
+    return input.default
+  }
+  switch (input.type) {
+    case 'int':
+    case 'float':
+    case 'number':
+      return 0
+    case 'color':
+      return '#000000'
+    case 'categorical':
+    case 'select':
+      return input.options ? input.options[0] : ''
+    case 'bool':
+    case 'checkbox':
+      return false
+    default:
+      return ''
+  }
+}
+
+// Convert transform inputs to params object
+function getParams (transform) {
+  const params = {}
+  transform.inputs.forEach(i => {
+    params[i.name] = i.type === 'file' ? i.file : i.value
+  })
+  return params
+}
+
+// Plain stage descriptors that can be posted to a worker, ids tie them back to their cards
+function getStages (pipeline) {
+  return pipeline.map(transform => ({
+    id: transform.id,
+    name: transform.name,
+    params: getParams(transform)
+  }))
+}
+
+// Pipeline as JSON: transform names and input values, files by name only
+function serializePipeline (pipeline, title) {
+  return {
+    version: PIPELINE_VERSION,
+    title: title || '',
+    transforms: pipeline.map(transform => {
+      const inputs = {}
+      transform.inputs.forEach(i => {
+        inputs[i.name] = i.type === 'file' ? (i.file ? i.file.name : null) : i.value
+      })
+      return { name: transform.name, inputs }
+    })
+  }
+}
+
+// Stage descriptors from saved JSON, inputs missing from it get their defaults
+function deserializeStages (json) {
+  if (!json || !Array.isArray(json.transforms)) {
+    throw new Error('Not a saved pipeline')
+  }
+  return json.transforms.map((saved, i) => {
+    const Transform = transforms[saved.name]
+    if (!Transform) {
+      throw new Error(`Unknown transform: ${saved.name}`)
+    }
+    const params = {}
+    new Transform(i).inputs.forEach(input => {
+      params[input.name] = input.name in saved.inputs ? saved.inputs[input.name] : defaultValue(input)
+    })
+    return { id: i, name: saved.name, params }
+  })
+}
+
+// Index of the first DOM-bound stage, everything before it can run off the UI thread
+function getOutputIndex (stages) {
+  const i = stages.findIndex(s => transforms[s.name].type === 'output')
+  return i === -1 ? stages.length : i
+}
+
+// Stages before the first Branch card are the shared trunk, each Branch card starts a branch
+// running up to the next one
+function splitBranches (stages) {
+  const i = stages.findIndex(s => transforms[s.name].type === 'branch')
+  if (i === -1) {
+    return { trunk: stages, branches: [] }
+  }
+  const branches = []
+  for (const stage of stages.slice(i)) {
+    if (transforms[stage.name].type === 'branch') {
+      branches.push([])
+    } else {
+      branches[branches.length - 1].push(stage)
+    }
+  }
+  return { trunk: stages.slice(0, i), branches }
+}
+
+// Part of a pipeline that can run off the UI thread: the trunk and every branch up to its first output,
+// Branch cards kept so branches are numbered the same on both sides. Null when the trunk has an output.
+function splitOutputs (stages) {
+  const { trunk, branches } = splitBranches(stages)
+  if (!branches.length) {
+    const i = getOutputIndex(stages)
+    return { worker: stages.slice(0, i), outputs: [stages.slice(i)] }
+  }
+  if (getOutputIndex(trunk) < trunk.length) {
+    return null
+  }
+  const worker = trunk.slice()
+  const outputs = []
+  let b = 0
+  for (const stage of stages.slice(trunk.length)) {
+    if (transforms[stage.name].type === 'branch') {
+      worker.push(stage)
+      outputs.push([])
+      b = outputs.length - 1
+    } else if (outputs[b].length || transforms[stage.name].type === 'output') {
+      outputs[b].push(stage)
+    } else {
+      worker.push(stage)
+    }
+  }
+  return { worker, outputs }
+}
+
+// Let stages take over their upstream neighbour, e.g. parallel parsers reading the file directly.
+// Loaders feeding a binary-only stage are switched to binary chunks.
+// needed: fields read after this chain, null for all of them.
+// Without pushdown, filters and projections are not pushed into parsers, so a parser's output
+// (and its cache key) does not change with the stages after it.
+function plan (stages, needed = null, pushdown = true) {
+  const planned = []
+  for (const stage of stages) {
+    const Transform = transforms[stage.name]
+    const prev = planned[planned.length - 1]
+    if (prev && Transform.inputType === 'binary' && 'Encoding' in prev.params) {
+      prev.params = Object.assign({}, prev.params, { 'Encoding': 'Binary' })
+    }
+    const fusable = prev && Transform.fuse && (pushdown || transforms[prev.name].type !== 'parser')
+    const fused = fusable ? Transform.fuse(prev, stage) : null
+    if (fused) {
+      planned[planned.length - 1] = Object.assign({ id: fused.name === stage.name ? stage.id : prev.id }, fused)
+    } else {
+      planned.push(stage)
+    }
+  }
+  if (pushdown) pushProjection(planned, needed)
+  return planned
+}
+
+// Walk back from the outputs collecting the fields later stages read, and tell parsers to produce only those.
+// Stages without a static requires(params, needed) are assumed to read every field.
+// Returns the fields the chain reads from its input.
+function pushProjection (stages, needed = null) {
+  for (let i = stages.length - 1; i >= 0; i--) {
+    const Transform = transforms[stages[i].name]
+    if (Transform.type === 'parser' && needed) {
+      stages[i] = Object.assign({}, stages[i], {
+        params: Object.assign({}, stages[i].params, { 'Fields': needed })
+      })
+    }
+    needed = Transform.requires ? Transform.requires(stages[i].params, needed) : null
+  }
+  return needed
+}
+
+// Branches are planned on their own, no stage fuses across the fork,
+// and the trunk produces the fields any of them reads.
+// A cached trunk gets no pushdown, branches are never cached.
+function planBranches (stages, cached) {
+  const { trunk, branches } = splitBranches(stages)
+  let needed = null
+  const planned = branches.map((branch, b) => {
+    const chain = plan(branch)
+    // Walked again on a copy for the fields the branch reads from the trunk
+    const fields = pushProjection(chain.slice())
+    needed = b === 0 ? fields : (needed && fields ? Array.from(new Set(needed.concat(fields))) : null)
+    return chain
+  })
+  return { trunk: plan(trunk, needed, !cached), branches: planned }
+}
+
+// Record and batch outputs of non-output stages are worth keeping, text and bytes are cheaper to re-read
+function cacheable (stage) {
+  const Transform = transforms[stage.name]
+  const type = Transform.getOutputType ? Transform.getOutputType(stage.params) : Transform.outputType
+  return Transform.type !== 'output' && (type === 'object' || type === 'batch')
+}
+
+// Number of leading stages whose output can be replayed from the cache
+function resumeIndex (stages, keys, cache) {
+  for (let i = stages.length - 1; i >= 0; i--) {
+    if (cacheable(stages[i]) && cache.get(keys[i])) {
+      return i + 1
+    }
+  }
+  return 0
+}
+
+// Passes the records a stream produces to onRows. push is wrapped the way instrument() does it,
+// a 'data' listener would start the stream flowing before the next stage is piped.
+function countRows (stream, onRows) {
+  const push = stream.push
+  if (push) {
+    stream.push = function (chunk, ...args) {
+      if (chunk !== null) onRows(countRecords(chunk))
+      return push.call(this, chunk, ...args)
+    }
+  } else {
+    // Classic streams emit 'data' whether or not anyone listens
+    stream.on('data', chunk => onRows(countRecords(chunk)))
+  }
+  return stream
+}
+
+// One linear chain of planned stages, read from source when it is given.
+// upstream: metrics of the stage feeding source
+async function buildChain (planned, options, source, upstream, limit) {
+  let readStream = source
+  let writeStream = source
+  let gateStream = null
+  const metrics = []
+  const cache = options.cache || null
+  const keys = cache ? stageKeys(planned) : []
+  const first = cache ? resumeIndex(planned, keys, cache) : 0
+  // Every stream of the chain, pipe() does not forward their errors
+  const streams = source ? [source] : []
+  const add = (stream) => {
+    streams.push(stream)
+    writeStream = writeStream.pipe(stream)
+  }
+
+  const addGate = () => {
+    gateStream = gate(limit)
+    add(gateStream)
+  }
+
+  if (first > 0) {
+    readStream = writeStream = cache.readStream(cache.get(keys[first - 1]))
+    streams.push(readStream)
+    if (options.onRows) countRows(readStream, options.onRows)
+    for (let i = 0; i < first; i++) {
+      if (options.onMetadata && cache.metadata.has(keys[i])) {
+        options.onMetadata(planned[i].id, cache.metadata.get(keys[i]))
+      }
+    }
+  }
+
+  for (let i = first; i < planned.length; i++) {
+    const stage = planned[i]
+    const params = stage.params
+    // Init stream
+    let nextStream = await transforms[stage.name].initStream(params, { id: stage.id, name: stage.name, memory: options.memory })
+    nextStream.on('metadata', (metadata) => {
+      if (cache) cache.metadata.set(keys[i], metadata)
+      if (options.onMetadata) options.onMetadata(stage.id, metadata)
+    })
+    if (options.onRows && transforms[stage.name].type === 'parser') {
+      countRows(nextStream, options.onRows)
+    }
+    if (options.metrics) {
+      const stageMetrics = new StageMetrics()
+      instrument(nextStream, stageMetrics, metrics.length ? metrics[metrics.length - 1].metrics : upstream)
+      metrics.push({ id: stage.id, metrics: stageMetrics })
+    }
+    if (typeof readStream === 'undefined') {
+      readStream = writeStream = nextStream
+      streams.push(nextStream)
+      if (nextStream.emitsProgress && options.onProgress) {
+        nextStream.on('progress', options.onProgress)
+      } else if ((nextStream.size || (params['File'] && params['File'].size)) && options.onProgress) {
+        let size = nextStream.size || params['File'].size
+        let progressBytes = 0
+        const progressStream = through2(function (chunk, enc, callback) {
+          progressBytes += chunk.length
+          options.onProgress(progressBytes, size)
+          this.push(chunk)
+          callback()
+        })
+        add(progressStream)
+      }
+    } else {
+      if (limit && !gateStream && transforms[stage.name].type === 'output') {
+        addGate()
+      }
+      add(nextStream)
+    }
+    if (cache && cacheable(stage)) {
+      add(cache.recorder(keys[i], options.memory))
+    }
+  }
+  if (limit && !gateStream && typeof writeStream !== 'undefined') {
+    addGate()
+  }
+
+  // A failing stage stops the chain, so stages drop what they hold (spill files included),
+  // and fails its end, where callers listen
+  streams.forEach(stream => {
+    if (stream === writeStream) return
+    stream.on('error', err => {
+      streams.forEach(s => {
+        if (s !== writeStream && s !== stream && s.destroy) s.destroy()
+      })
+      if (writeStream.destroy) {
+        writeStream.destroy(err)
+      } else {
+        writeStream.emit('error', err)
+      }
+    })
+  })
+
+  // Stops every stage, for cancelled runs
+  const destroy = () => streams.forEach(stream => {
+    if (stream.destroy) stream.destroy()
+  })
+  return {readStream, writeStream, gate: gateStream, metrics, destroy}
+}
+
+// Options: onProgress(loaded, total) callback, onRows(n) with the records parsers produce,
+// onMetadata(id, metadata) for what stages learn while running,
+// limit to pass only that many records to the outputs until gate.more(n) is called,
+// metrics to count what passes through every stage, returned as [{id, metrics}],
+// cache (a StageCache) to record stage outputs and resume after the last stage still cached.
+// Cached chains are planned without pushdown into parsers, so editing a later Filter or Select
+// resumes from the parsed records. A stage's output is committed when the stage ends, so a run
+// held by the gate commits nothing until more() has let all of it through.
+// memoryLimit in bytes for the MemoryManager shared by all stages, returned as memory.
+// branches has the end and gate of every branch, a linear pipeline is a single one.
+// destroy() stops every stage, which drops their spill files.
+// Only the shared trunk is cached, branches are cheap to re-run from it.
+async function build (stages, options = {}) {
+  const memory = new MemoryManager(options.memoryLimit)
+  options = Object.assign({}, options, { memory })
+  const { trunk, branches } = planBranches(stages, !!options.cache)
+  if (!branches.length) {
+    const chain = await buildChain(trunk, options, undefined, null, options.limit)
+    return Object.assign(chain, { memory, branches: [{ writeStream: chain.writeStream, gate: chain.gate }] })
+  }
+  if (!trunk.length) {
+    throw new Error('Branches need the stages they share before the first Branch')
+  }
+
+  const shared = await buildChain(trunk, options, undefined, null, 0)
+  const upstream = shared.metrics.length ? shared.metrics[shared.metrics.length - 1].metrics : null
+  const sources = tee(shared.writeStream, branches.length)
+  const built = []
+  for (let b = 0; b < branches.length; b++) {
+    const branchOptions = Object.assign({}, options, { cache: null })
+    built.push(await buildChain(branches[b], branchOptions, sources[b], upstream, options.limit))
+  }
+
+  return {
+    readStream: shared.readStream,
+    writeStream: built[0].writeStream,
+    gate: built[0].gate,
+    metrics: shared.metrics.concat(...built.map(chain => chain.metrics)),
+    memory,
+    destroy: () => [shared].concat(built).forEach(chain => chain.destroy()),
+    branches: built.map(chain => ({ writeStream: chain.writeStream, gate: chain.gate }))
+  }
+}
+
+module.exports = {
+  defaultValue,
+  serializePipeline,
+  deserializeStages,
+  getParams,
+  getStages,
+  getOutputIndex,
+  splitBranches,
+  splitOutputs,
+  plan,
+  build
+}
@@ -0,0 +1,135 @@
+// Runs loaders, parsers and transforms off the UI thread.
+// Only progress snapshots, stage metadata and metrics with memory usage, row counts and batches of output chunks are posted back,
+// chunks tagged with the branch they belong to. The main thread acknowledges every data message,
+// a branch with too many unacknowledged ones is paused.
+const { build } = require('./pipeline')
+const { RecordBatch } = require('./batch')
+const { snapshots } = require('./metrics')
+const { StageCache } = require('./cache')
+const { ProgressCounter } = require('./progress')
+const { clearSpills } = require('./spill')
+
+const FLUSH_INTERVAL = 100 // ms
+const FLUSH_SIZE = 1000 // chunks
+const METRICS_INTERVAL = 250 // ms
+const PROGRESS_INTERVAL = 100 // ms
+const MAX_IN_FLIGHT = 2 // posted data messages per branch the main thread has not acknowledged
+
+let current = null
+// Lives as long as the worker, so later runs can resume from stages cached by earlier ones
+const cache = new StageCache()
+
+function post (runId, message) {
+  self.postMessage(Object.assign({ runId }, message))
+}
+
+async function start (runId, stages, limit, useCache, memoryLimit) {
+  // Earlier runs of this worker are over, their spill files can go
+  await clearSpills()
+  let rows = 0
+  const progress = new ProgressCounter()
+
+  const streams = await build(stages, {
+    onProgress: (loaded, total) => progress.update(loaded, total),
+    onRows: (n) => progress.addRows(n),
+    onMetadata: (id, metadata) => post(runId, { type: 'metadata', id, metadata }),
+    metrics: true,
+    cache: useCache ? cache : null,
+    memoryLimit,
+    limit
+  })
+  const branches = streams.branches
+  const chunks = branches.map(() => [])
+  // A branch is paused while the main thread is behind, so backpressure reaches the stages here
+  const inFlight = branches.map(() => 0)
+
+  // Cached batches may share buffers with posted ones, and so do the batches of different branches,
+  // those are copied instead of transferred
+  const transfer = !useCache && branches.length === 1
+  const flush = () => {
+    chunks.forEach((list, branch) => {
+      if (list.length) {
+        self.postMessage({ runId, type: 'data', branch, chunks: list, rows }, transfer ? RecordBatch.transferables(list) : [])
+        // Copied batches can go back to their pool, transferred ones are detached
+        if (!transfer) list.forEach(RecordBatch.release)
+        chunks[branch] = []
+        if (++inFlight[branch] >= MAX_IN_FLIGHT) branches[branch].writeStream.pause()
+      }
+    })
+  }
+
+  const report = () => post(runId, { type: 'metrics', stages: snapshots(streams.metrics), memory: streams.memory.usage() })
+  const reportProgress = () => post(runId, { type: 'progress', progress: progress.snapshot() })
+  const run = current = {
+    runId,
+    streams,
+    ack: (branch) => {
+      if (--inFlight[branch] < MAX_IN_FLIGHT) branches[branch].writeStream.resume()
+    },
+    timer: setInterval(flush, FLUSH_INTERVAL),
+    metricsTimer: setInterval(report, METRICS_INTERVAL),
+    progressTimer: setInterval(reportProgress, PROGRESS_INTERVAL)
+  }
+
+  let open = branches.length
+  branches.forEach(({ writeStream, gate }, branch) => {
+    if (gate) {
+      gate.on('hold', flush)
+    }
+    writeStream.on('data', (chunk) => {
+      if (run !== current) return
+      chunks[branch].push(chunk)
+      rows += RecordBatch.isBatch(chunk) ? chunk.length : 1
+      if (chunks[branch].length >= FLUSH_SIZE) {
+        flush()
+      }
+    })
+    writeStream.on('end', () => {
+      if (run !== current || --open > 0) return
+      clearInterval(run.timer)
+      clearInterval(run.metricsTimer)
+      clearInterval(run.progressTimer)
+      flush()
+      report()
+      reportProgress()
+      post(runId, { type: 'end', rows })
+    })
+    // Every stage's error ends up here, the first one stops the run
+    writeStream.on('error', (err) => {
+      if (run !== current) return
+      cancel()
+      post(runId, { type: 'error', message: err.message })
+    })
+  })
+}
+
+function cancel () {
+  if (current) {
+    const streams = current.streams
+    clearInterval(current.timer)
+    clearInterval(current.metricsTimer)
+    clearInterval(current.progressTimer)
+    current = null
+    streams.destroy()
+  }
+}
+
+self.onmessage = function (e) {
+  const message = e.data
+  switch (message.type) {
+    case 'run':
+      cancel()
+      start(message.runId, message.stages, message.limit, message.cache, message.memoryLimit)
+        .catch(err => post(message.runId, { type: 'error', message: err.message }))
+      break
+    case 'ack':
+      if (current && current.runId === message.runId) current.ack(message.branch)
+      break
+    case 'more':
+      if (current) current.streams.branches.forEach(b => b.gate && b.gate.more(message.rows))
+      break
+    case 'cancel':
+      cancel()
+      break
+  }
+}
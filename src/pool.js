@@ -0,0 +1,63 @@
+// Typed arrays recycled between batches, so a steady stream of batches stops allocating column buffers.
+//
+// Ownership: a pooled batch carries a Lease over its buffers. The stage holding a batch owns it;
+// pushing it downstream hands ownership on. A stage that drops a batch, or only keeps what it
+// copied out of it, calls release(). Views sharing the buffers (project, slice, withColumns)
+// take their own reference, so the source can be released as soon as the view is pushed.
+// Batches kept for later (previews, the stage cache) are never released, and a batch nobody
+// releases is collected as usual: releasing is an optimization, reading a released batch is the bug.
+const MAX_FREE = 16 // arrays kept per type and length
+
+class BufferPool {
+  constructor () {
+    this.free = new Map()
+  }
+
+  acquire (Type, length) {
+    const list = this.free.get(Type)
+    const arrays = list && list.get(length)
+    return arrays && arrays.length ? arrays.pop() : new Type(length)
+  }
+
+  // Arrays transferred to another thread are detached and dropped here
+  recycle (array) {
+    if (!array.buffer.byteLength) return
+    let list = this.free.get(array.constructor)
+    if (!list) {
+      list = new Map()
+      this.free.set(array.constructor, list)
+    }
+    let arrays = list.get(array.length)
+    if (!arrays) {
+      arrays = []
+      list.set(array.length, arrays)
+    }
+    if (arrays.length < MAX_FREE) arrays.push(array)
+  }
+}
+
+// Reference count over the full arrays behind a batch's columns
+class Lease {
+  constructor (pool, arrays) {
+    this.pool = pool
+    this.arrays = arrays
+    this.count = 1
+  }
+
+  retain () {
+    this.count += 1
+  }
+
+  release () {
+    this.count -= 1
+    if (this.count === 0) {
+      this.arrays.forEach(array => this.pool.recycle(array))
+      this.arrays = null
+    }
+  }
+}
+
+module.exports = {
+  BufferPool,
+  Lease
+}
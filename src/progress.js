@@ -0,0 +1,55 @@
+// Run progress as plain counters. The pipeline only bumps numbers per chunk,
+// readers sample snapshot() on their own clock: animation frames on the main thread,
+// a timer in the worker and the CLI.
+const SMOOTHING = 0.3 // weight of the latest sample in the rates
+
+const now = () => (typeof performance !== 'undefined' ? performance.now() : Date.now())
+
+class ProgressCounter {
+  constructor () {
+    this.loaded = 0
+    this.total = 0
+    this.rows = 0
+    this.started = now()
+    // The first sample's rates are averages since the start, later ones are smoothed
+    this.last = { t: this.started, loaded: 0, rows: 0, first: true }
+    this.bytesPerSecond = 0
+    this.rowsPerSecond = 0
+  }
+
+  // Same signature as build()'s onProgress
+  update (loaded, total) {
+    this.loaded = loaded
+    this.total = total
+  }
+
+  addRows (n) {
+    this.rows += n
+  }
+
+  // Plain object that can be posted, eta in ms or null while unknown
+  snapshot () {
+    const t = now()
+    if (t > this.last.t) {
+      const seconds = (t - this.last.t) / 1000
+      const bytesRate = (this.loaded - this.last.loaded) / seconds
+      const rowsRate = (this.rows - this.last.rows) / seconds
+      this.bytesPerSecond = this.last.first ? bytesRate : this.bytesPerSecond + SMOOTHING * (bytesRate - this.bytesPerSecond)
+      this.rowsPerSecond = this.last.first ? rowsRate : this.rowsPerSecond + SMOOTHING * (rowsRate - this.rowsPerSecond)
+    }
+    this.last = { t, loaded: this.loaded, rows: this.rows, first: false }
+    return {
+      loaded: this.loaded,
+      total: this.total,
+      rows: this.rows,
+      elapsed: t - this.started,
+      bytesPerSecond: this.bytesPerSecond,
+      rowsPerSecond: this.rowsPerSecond,
+      eta: this.total && this.bytesPerSecond > 0 ? (this.total - this.loaded) / this.bytesPerSecond * 1000 : null
+    }
+  }
+}
+
+module.exports = {
+  ProgressCounter
+}
@@ -0,0 +1,287 @@
+const { Readable } = require('stream')
+
+const MIN_CHUNK = 64 * 1024
+const MAX_CHUNK = 64 * 1024 * 1024
+const NEWLINE = 0x0A
+const SAMPLE_WINDOW = 64 * 1024
+const SAMPLE_CHUNK_LINES = 1000
+
+// Reads a Blob in slices. In adaptive mode the slice size is tuned so one read-process cycle
+// (reading a slice and pushing it through the synchronous part of the pipeline) takes about
+// targetLatency ms: big enough to amortize per-chunk overhead, small enough to keep progress
+// and the UI responsive.
+class BlobReadStream extends Readable {
+  constructor (blob, options = {}) {
+    // No internal buffering: _read is only called again after downstream took the last chunk
+    super({ highWaterMark: 0 })
+    this.blob = blob
+    this.offset = options.start || 0
+    this.end = Math.min(typeof options.end === 'number' ? options.end : blob.size, blob.size)
+    this.chunkSize = options.chunkSize || 1024 * 1024
+    this.adaptive = !!options.adaptive
+    this.targetLatency = options.targetLatency || 50
+    this.cycleStart = null
+    this.reading = false
+  }
+
+  adapt (now) {
+    const cycle = Math.max(now - this.cycleStart, 1)
+    const factor = Math.min(2, Math.max(0.5, this.targetLatency / cycle))
+    this.chunkSize = Math.round(Math.min(MAX_CHUNK, Math.max(MIN_CHUNK, this.chunkSize * factor)))
+  }
+
+  _read () {
+    if (this.reading) return
+    if (this.offset >= this.end) {
+      this.push(null)
+      return
+    }
+    const now = performance.now()
+    if (this.adaptive && this.cycleStart !== null) {
+      this.adapt(now)
+    }
+    this.cycleStart = now
+    this.reading = true
+    const start = this.offset
+    const end = Math.min(this.end, start + this.chunkSize)
+    this.offset = end
+    this.blob.slice(start, end).arrayBuffer()
+      .then(buffer => {
+        this.reading = false
+        this.push(Buffer.from(buffer))
+      })
+      .catch(err => this.destroy(err))
+  }
+}
+
+// Fetches byte ranges of a URL concurrently and emits them in order.
+// A failed range is retried from the last byte received, so a dropped connection only re-fetches the rest.
+// URLs that turn out not to serve ranges are read over one plain GET.
+class HTTPRangeStream extends Readable {
+  constructor (url, options = {}) {
+    super({ highWaterMark: 0 })
+    this.url = url
+    this.concurrency = options.concurrency || 4
+    this.rangeSize = options.rangeSize || 4 * 1024 * 1024
+    this.retries = typeof options.retries === 'number' ? options.retries : 3
+    this.emitsProgress = true
+    this.size = null
+    this.body = null
+    this.next = 0
+    this.loaded = 0
+    this.pending = []
+    this.reading = false
+    this.wantMore = false
+  }
+
+  // A one-byte range answered with 206 and Content-Range gives the size. Accept-Ranges is not
+  // visible cross-origin and Content-Range only when the server exposes it, without it the file
+  // is streamed from a plain GET, or from the probe itself when the server ignored the range.
+  async _init () {
+    let res = await fetch(this.url, { headers: { 'Range': 'bytes=0-0' } })
+    const range = /\/(\d+)$/.exec(res.headers.get('content-range') || '')
+    if (res.status === 206 && range) {
+      res.body.cancel()
+      this.size = Number(range[1])
+      return
+    }
+    if (res.status === 206) {
+      res.body.cancel()
+      res = await fetch(this.url)
+    }
+    if (!res.ok) {
+      throw new Error(`${this.url} failed with status ${res.status}`)
+    }
+    this.size = Number(res.headers.get('content-length')) || 0
+    this.body = res.body.getReader()
+  }
+
+  async _pumpBody () {
+    while (true) {
+      const { done, value } = await this.body.read()
+      if (done) {
+        this.push(null)
+        return
+      }
+      this.loaded += value.length
+      this.emit('progress', this.loaded, this.size)
+      if (!this.push(Buffer.from(value.buffer, value.byteOffset, value.length))) return
+    }
+  }
+
+  async _fetchRange (start, end) {
+    const chunks = []
+    let received = 0
+    for (let attempt = 0; ; attempt++) {
+      try {
+        const res = await fetch(this.url, { headers: { 'Range': `bytes=${start + received}-${end - 1}` } })
+        if (res.status !== 206) {
+          throw new Error(`Range request failed with status ${res.status}`)
+        }
+        const reader = res.body.getReader()
+        while (true) {
+          const { done, value } = await reader.read()
+          if (done) break
+          chunks.push(value)
+          received += value.length
+          this.loaded += value.length
+          this.emit('progress', this.loaded, this.size)
+        }
+        if (received < end - start) {
+          throw new Error('Connection closed before the end of the range')
+        }
+        return Buffer.concat(chunks)
+      } catch (err) {
+        if (attempt >= this.retries) throw err
+        await new Promise(resolve => setTimeout(resolve, 500 * Math.pow(2, attempt)))
+      }
+    }
+  }
+
+  _fill () {
+    while (this.next < this.size && this.pending.length < this.concurrency) {
+      const start = this.next
+      const end = Math.min(this.size, start + this.rangeSize)
+      this.next = end
+      const task = this._fetchRange(start, end)
+      task.catch(() => {})
+      this.pending.push(task)
+    }
+  }
+
+  async _pump () {
+    if (this.size === null) await this._init()
+    if (this.body) return this._pumpBody()
+    while (true) {
+      this._fill()
+      if (!this.pending.length) {
+        this.push(null)
+        return
+      }
+      const buffer = await this.pending.shift()
+      if (!this.push(buffer)) return
+    }
+  }
+
+  _read () {
+    if (this.reading) {
+      this.wantMore = true
+      return
+    }
+    this.reading = true
+    this._pump()
+      .catch(err => this.destroy(err))
+      .then(() => {
+        this.reading = false
+        if (this.wantMore) {
+          this.wantMore = false
+          this._read()
+        }
+      })
+  }
+
+  _destroy (err, callback) {
+    if (this.body) this.body.cancel().catch(() => {})
+    callback(err)
+  }
+}
+
+// Reservoir sample of the lines of a Blob, read from `windows` random offsets instead of the whole file.
+// A window starting mid-line skips to the next newline and only complete lines are kept.
+// The header line is emitted first, sampled lines follow in file order.
+// Quoted fields with embedded newlines can be cut, so the sample is meant for previews.
+class SampleReadStream extends Readable {
+  constructor (blob, options = {}) {
+    super()
+    this.blob = blob
+    this.rows = options.rows || 1000
+    this.windows = options.windows || 64
+    this.header = options.header !== false
+    this.emitsProgress = true
+    this.reservoir = []
+    this.seen = 0
+    this.lines = null
+    this.sampling = false
+  }
+
+  // Algorithm R over every complete line read, kept with its offset to restore file order
+  add (offset, line) {
+    if (this.reservoir.length < this.rows) {
+      this.reservoir.push([offset, line])
+    } else {
+      const j = Math.floor(Math.random() * (this.seen + 1))
+      if (j < this.rows) this.reservoir[j] = [offset, line]
+    }
+    this.seen += 1
+  }
+
+  async _sample () {
+    const size = this.blob.size
+    const head = Buffer.from(await this.blob.slice(0, SAMPLE_WINDOW).arrayBuffer())
+    const headerEnd = this.header ? head.indexOf(NEWLINE) + 1 : 0
+    const start = this.header && headerEnd === 0 ? size : headerEnd
+    const offsets = []
+    if (size - start <= this.windows * SAMPLE_WINDOW) {
+      // Small files are read whole
+      for (let offset = start; offset < size; offset += SAMPLE_WINDOW) offsets.push(offset)
+    } else {
+      for (let i = 0; i < this.windows; i++) {
+        offsets.push(start + Math.floor(Math.random() * (size - start - SAMPLE_WINDOW)))
+      }
+      offsets.sort((a, b) => a - b)
+    }
+    // Bytes before `covered` were already read and it always sits at a line start
+    let covered = start
+    for (let i = 0; i < offsets.length; i++) {
+      const from = Math.max(offsets[i], covered)
+      const to = Math.min(size, offsets[i] + SAMPLE_WINDOW)
+      if (from < to) {
+        const buf = Buffer.from(await this.blob.slice(from, to).arrayBuffer())
+        let lineStart = from === covered ? 0 : buf.indexOf(NEWLINE) + 1
+        if (lineStart > 0 || from === covered) {
+          let nl = buf.indexOf(NEWLINE, lineStart)
+          while (nl !== -1) {
+            this.add(from + lineStart, buf.subarray(lineStart, nl + 1))
+            lineStart = nl + 1
+            nl = buf.indexOf(NEWLINE, lineStart)
+          }
+          // The last line of the file may have no newline
+          if (to === size && lineStart < buf.length) {
+            this.add(from + lineStart, Buffer.concat([buf.subarray(lineStart), Buffer.from('\n')]))
+            lineStart = buf.length
+          }
+          covered = from + lineStart
+        }
+      }
+      this.emit('progress', i + 1, offsets.length)
+    }
+    this.reservoir.sort((a, b) => a[0] - b[0])
+    this.lines = this.reservoir.map(entry => entry[1])
+    this.reservoir = []
+    if (headerEnd > 0) {
+      this.lines.unshift(head.subarray(0, headerEnd))
+    }
+  }
+
+  _read () {
+    if (this.lines === null) {
+      if (this.sampling) return
+      this.sampling = true
+      this._sample()
+        .then(() => this._read())
+        .catch(err => this.destroy(err))
+      return
+    }
+    if (!this.lines.length) {
+      this.push(null)
+      return
+    }
+    this.push(Buffer.concat(this.lines.splice(0, SAMPLE_CHUNK_LINES)))
+  }
+}
+
+module.exports = {
+  BlobReadStream,
+  HTTPRangeStream,
+  SampleReadStream
+}
@@ -0,0 +1,132 @@
+// Turns parsed string value arrays into output records: objects or columnar batches.
+// Only projected and filtered columns are cast, and rows failing a pushed-down filter
+// are dropped before anything is built for them.
+const { BatchBuilder } = require('./batch')
+const { expressionFields, compileValuesFilter } = require('./expr')
+const { inferSchema, compileCast } = require('./schema')
+
+// Same rule as csv-parse's cast option
+function castNumber (value) {
+  if (typeof value !== 'string' || value === '') return value
+  const n = parseFloat(value)
+  return value - n + 1 >= 0 ? n : value
+}
+
+// Object with only the given fields, null where the record lacks one, so every record has the
+// same shape. Other values pass through.
+function pick (record, fields) {
+  if (record === null || typeof record !== 'object') {
+    return record
+  }
+  const picked = {}
+  for (const field of fields) {
+    picked[field] = field in record ? record[field] : null
+  }
+  return picked
+}
+
+function indicesOf (names, header) {
+  return names.map(name => header.indexOf(name)).filter(i => i !== -1)
+}
+
+class RowAssembler {
+  constructor (header, options = {}) {
+    this.header = header
+    this.outputIndices = options.fields ? indicesOf(options.fields, header) : header.map((name, i) => i)
+    this.outputNames = this.outputIndices.map(i => header[i])
+    const filterIndices = options.filter ? indicesOf(expressionFields(options.filter), header) : []
+    this.castIndices = Array.from(new Set(this.outputIndices.concat(filterIndices)))
+    this.filter = options.filter ? compileValuesFilter(options.filter, header) : null
+    this.builder = options.batchSize ? new BatchBuilder(this.outputNames, options.batchSize, options.pool) : null
+    // Typed casts from a given schema or one inferred from the first `sample` rows,
+    // per value guessing with castNumber otherwise
+    this.onSchema = options.onSchema || null
+    this.casts = null
+    this.sampleSize = options.sample || 0
+    this.sample = null
+    if (options.schema) {
+      this.setSchema(options.schema)
+    } else if (this.sampleSize) {
+      this.sample = []
+    }
+  }
+
+  setSchema (schema) {
+    const types = Object.create(null)
+    schema.forEach(c => { types[c.name] = c.type })
+    this.schema = schema
+    this.casts = this.castIndices.map(i => compileCast(types[this.header[i]]))
+    if (this.onSchema) {
+      this.onSchema(schema)
+    }
+  }
+
+  flushSample (emit) {
+    const rows = this.sample
+    this.sample = null
+    this.setSchema(inferSchema(this.header, rows, this.castIndices))
+    for (const values of rows) {
+      this.assemble(values, emit)
+    }
+  }
+
+  toObject (values) {
+    const record = {}
+    const names = this.outputNames
+    const indices = this.outputIndices
+    for (let j = 0; j < indices.length; j++) {
+      if (indices[j] < values.length) {
+        record[names[j]] = values[indices[j]]
+      }
+    }
+    return record
+  }
+
+  // Calls emit for each finished object or batch
+  write (values, emit) {
+    if (this.sample !== null) {
+      this.sample.push(values)
+      if (this.sample.length >= this.sampleSize) {
+        this.flushSample(emit)
+      }
+      return
+    }
+    this.assemble(values, emit)
+  }
+
+  assemble (values, emit) {
+    const indices = this.castIndices
+    const casts = this.casts
+    for (let j = 0; j < indices.length; j++) {
+      if (indices[j] < values.length) {
+        values[indices[j]] = casts ? casts[j](values[indices[j]]) : castNumber(values[indices[j]])
+      }
+    }
+    if (this.filter && !this.filter(values)) {
+      return
+    }
+    if (this.builder) {
+      this.builder.appendAt(values, this.outputIndices)
+      if (this.builder.full) {
+        emit(this.builder.flush())
+      }
+    } else {
+      emit(this.toObject(values))
+    }
+  }
+
+  end (emit) {
+    if (this.sample !== null) {
+      this.flushSample(emit)
+    }
+    if (this.builder && this.builder.length) {
+      emit(this.builder.flush())
+    }
+  }
+}
+
+module.exports = {
+  castNumber,
+  pick,
+  RowAssembler
+}
@@ -0,0 +1,43 @@
+// Column types inferred from a sample of string values, and one cast function per type.
+// A column is numeric only when every sampled value is written as a plain number,
+// so codes like "007" keep their leading zeros.
+const NUMBER = 'number'
+const STRING = 'string'
+
+const NUMBER_PATTERN = /^[-+]?(?:(?:0|[1-9]\d*)(?:\.\d*)?|\.\d+)(?:[eE][-+]?\d+)?$/
+
+function inferType (rows, index) {
+  let seen = false
+  for (let i = 0; i < rows.length; i++) {
+    const v = rows[i][index]
+    if (typeof v !== 'string' || v === '') continue
+    if (!NUMBER_PATTERN.test(v)) return STRING
+    seen = true
+  }
+  return seen ? NUMBER : STRING
+}
+
+// [{name, type}] for the header columns at `indices`
+function inferSchema (header, rows, indices) {
+  return indices.map(i => ({ name: header[i], type: inferType(rows, i) }))
+}
+
+// Values that stop parsing as numbers after the sample are kept as strings,
+// with the same plain-number rule the sample was inferred by
+function castToNumber (value) {
+  if (typeof value !== 'string' || !NUMBER_PATTERN.test(value)) return value
+  return +value
+}
+
+const castToString = (value) => value
+
+function compileCast (type) {
+  return type === NUMBER ? castToNumber : castToString
+}
+
+module.exports = {
+  NUMBER,
+  STRING,
+  inferSchema,
+  compileCast
+}
@@ -0,0 +1,192 @@
+// Mergeable approximate summaries: HyperLogLog for distinct counts, t-digest for quantiles.
+// Both serialize to small JSON values so aggregation state can be spilled and merged later.
+
+function mixK (k) {
+  k = Math.imul(k, 0xcc9e2d51)
+  k = (k << 15) | (k >>> 17)
+  return Math.imul(k, 0x1b873593)
+}
+
+// MurmurHash3 x86 32-bit over the UTF-16 code units of a string, two per block
+function hash32 (str, seed = 0) {
+  let h = seed
+  const n = str.length
+  let i = 0
+  for (; i + 2 <= n; i += 2) {
+    h ^= mixK(str.charCodeAt(i) | (str.charCodeAt(i + 1) << 16))
+    h = (h << 13) | (h >>> 19)
+    h = (Math.imul(h, 5) + 0xe6546b64) | 0
+  }
+  if (i < n) {
+    h ^= mixK(str.charCodeAt(i))
+  }
+  h ^= n * 2
+  h ^= h >>> 16
+  h = Math.imul(h, 0x85ebca6b)
+  h ^= h >>> 13
+  h = Math.imul(h, 0xc2b2ae35)
+  h ^= h >>> 16
+  return h >>> 0
+}
+
+// 2^p registers, ~1.6% standard error at p = 12
+class HyperLogLog {
+  constructor (p = 12, registers) {
+    this.p = p
+    this.m = 1 << p
+    this.registers = registers || new Uint8Array(this.m)
+  }
+
+  add (value) {
+    const h = hash32(String(value))
+    const index = h >>> (32 - this.p)
+    const rank = Math.min(Math.clz32((h << this.p) | 0) + 1, 32 - this.p + 1)
+    if (rank > this.registers[index]) {
+      this.registers[index] = rank
+    }
+  }
+
+  merge (other) {
+    for (let i = 0; i < this.m; i++) {
+      if (other.registers[i] > this.registers[i]) {
+        this.registers[i] = other.registers[i]
+      }
+    }
+    return this
+  }
+
+  count () {
+    const m = this.m
+    let sum = 0
+    let zeros = 0
+    for (let i = 0; i < m; i++) {
+      sum += Math.pow(2, -this.registers[i])
+      if (this.registers[i] === 0) zeros += 1
+    }
+    const alpha = 0.7213 / (1 + 1.079 / m)
+    let estimate = alpha * m * m / sum
+    if (estimate <= 2.5 * m && zeros > 0) {
+      estimate = m * Math.log(m / zeros)
+    } else if (estimate > 4294967296 / 30) {
+      estimate = -4294967296 * Math.log(1 - estimate / 4294967296)
+    }
+    return Math.round(estimate)
+  }
+
+  // Registers never exceed 33, so they pack into one char each
+  toJSON () {
+    return String.fromCharCode.apply(null, this.registers)
+  }
+
+  static fromJSON (json, p = 12) {
+    const registers = new Uint8Array(json.length)
+    for (let i = 0; i < json.length; i++) {
+      registers[i] = json.charCodeAt(i)
+    }
+    return new HyperLogLog(p, registers)
+  }
+}
+
+// Merging t-digest: centroids are kept sorted by mean, new points are buffered and merged in bulk
+class TDigest {
+  constructor (compression = 100) {
+    this.compression = compression
+    this.means = []
+    this.counts = []
+    this.buffer = []
+    this.total = 0
+  }
+
+  add (x, count = 1) {
+    if (typeof x !== 'number' || x !== x) return
+    this.buffer.push(x, count)
+    this.total += count
+    if (this.buffer.length > 20 * this.compression) {
+      this.compress()
+    }
+  }
+
+  merge (other) {
+    other.compress()
+    for (let i = 0; i < other.means.length; i++) {
+      this.add(other.means[i], other.counts[i])
+    }
+    return this
+  }
+
+  compress () {
+    if (!this.buffer.length) return
+    const points = []
+    for (let i = 0; i < this.means.length; i++) {
+      points.push([this.means[i], this.counts[i]])
+    }
+    for (let i = 0; i < this.buffer.length; i += 2) {
+      points.push([this.buffer[i], this.buffer[i + 1]])
+    }
+    points.sort((a, b) => a[0] - b[0])
+    const means = []
+    const counts = []
+    let seen = 0
+    let mean = points[0][0]
+    let count = points[0][1]
+    for (let i = 1; i < points.length; i++) {
+      const [m, c] = points[i]
+      const q = (seen + count + c / 2) / this.total
+      const limit = 4 * this.total * q * (1 - q) / this.compression
+      if (count + c <= Math.max(1, limit)) {
+        mean += (m - mean) * c / (count + c)
+        count += c
+      } else {
+        means.push(mean)
+        counts.push(count)
+        seen += count
+        mean = m
+        count = c
+      }
+    }
+    means.push(mean)
+    counts.push(count)
+    this.means = means
+    this.counts = counts
+    this.buffer = []
+  }
+
+  quantile (q) {
+    this.compress()
+    const n = this.means.length
+    if (n === 0) return null
+    if (n === 1) return this.means[0]
+    const target = q * this.total
+    let cumulative = 0
+    for (let i = 0; i < n; i++) {
+      const center = cumulative + this.counts[i] / 2
+      if (target < center) {
+        if (i === 0) return this.means[0]
+        const prevCenter = cumulative - this.counts[i - 1] / 2
+        const t = (target - prevCenter) / (center - prevCenter)
+        return this.means[i - 1] + t * (this.means[i] - this.means[i - 1])
+      }
+      cumulative += this.counts[i]
+    }
+    return this.means[n - 1]
+  }
+
+  toJSON () {
+    this.compress()
+    return [this.means, this.counts]
+  }
+
+  static fromJSON (json, compression = 100) {
+    const digest = new TDigest(compression)
+    digest.means = json[0]
+    digest.counts = json[1]
+    digest.total = json[1].reduce((a, b) => a + b, 0)
+    return digest
+  }
+}
+
+module.exports = {
+  hash32,
+  HyperLogLog,
+  TDigest
+}
@@ -0,0 +1,67 @@
+// Raw Snappy decompression, the default codec of Parquet writers. Compression is not needed,
+// files are written uncompressed.
+function readLength (bytes, state) {
+  let result = 0
+  let shift = 0
+  let b
+  do {
+    b = bytes[state.pos++]
+    result |= (b & 0x7f) << shift
+    shift += 7
+  } while (b & 0x80)
+  return result >>> 0
+}
+
+function uncompress (bytes) {
+  const state = { pos: 0 }
+  const out = new Uint8Array(readLength(bytes, state))
+  let pos = state.pos
+  let o = 0
+  while (pos < bytes.length) {
+    const tag = bytes[pos++]
+    const kind = tag & 3
+    if (kind === 0) {
+      let length = tag >> 2
+      if (length >= 60) {
+        const n = length - 59
+        length = 0
+        for (let i = 0; i < n; i++) length |= bytes[pos + i] << (8 * i)
+        pos += n
+      }
+      length += 1
+      out.set(bytes.subarray(pos, pos + length), o)
+      pos += length
+      o += length
+      continue
+    }
+    let length
+    let offset
+    if (kind === 1) {
+      length = ((tag >> 2) & 7) + 4
+      offset = ((tag >> 5) << 8) | bytes[pos++]
+    } else if (kind === 2) {
+      length = (tag >> 2) + 1
+      offset = bytes[pos] | (bytes[pos + 1] << 8)
+      pos += 2
+    } else {
+      length = (tag >> 2) + 1
+      offset = (bytes[pos] | (bytes[pos + 1] << 8) | (bytes[pos + 2] << 16) | (bytes[pos + 3] << 24)) >>> 0
+      pos += 4
+    }
+    if (offset === 0 || offset > o) {
+      throw new Error('Corrupt Snappy data')
+    }
+    // Copies may overlap their own output, byte by byte then
+    for (let i = 0; i < length; i++, o++) {
+      out[o] = out[o - offset]
+    }
+  }
+  if (o !== out.length) {
+    throw new Error('Corrupt Snappy data')
+  }
+  return out
+}
+
+module.exports = {
+  uncompress
+}
@@ -0,0 +1,161 @@
+// External merge sort: rows are sorted in memory up to a budget, spilled as sorted runs,
+// and k-way merged from the runs at the end
+const { createSpillFile } = require('./spill')
+const { recordSize } = require('./memory')
+
+const OUTPUT_SIZE = 1024
+
+// "a, -b" sorts by a ascending, then b descending; missing values go last
+function compileComparator (spec) {
+  const keys = spec.split(',').map(k => k.trim()).filter(k => k.length).map(k => (
+    k[0] === '-' ? { field: k.slice(1).trim(), order: -1 } : { field: k.replace(/^\+/, '').trim(), order: 1 }
+  ))
+  return (a, b) => {
+    for (const { field, order } of keys) {
+      const x = a[field]
+      const y = b[field]
+      if (x === y) continue
+      const xm = x === null || typeof x === 'undefined' || x === ''
+      const ym = y === null || typeof y === 'undefined' || y === ''
+      if (xm || ym) {
+        if (xm && ym) continue
+        return xm ? 1 : -1
+      }
+      if (x < y) return -order
+      if (x > y) return order
+    }
+    return 0
+  }
+}
+
+class MinHeap {
+  constructor (compare) {
+    this.compare = compare
+    this.items = []
+  }
+
+  get size () {
+    return this.items.length
+  }
+
+  push (item) {
+    const items = this.items
+    items.push(item)
+    let i = items.length - 1
+    while (i > 0) {
+      const parent = (i - 1) >> 1
+      if (this.compare(items[i], items[parent]) >= 0) break
+      ;[items[i], items[parent]] = [items[parent], items[i]]
+      i = parent
+    }
+  }
+
+  pop () {
+    const items = this.items
+    const top = items[0]
+    const last = items.pop()
+    if (items.length) {
+      items[0] = last
+      let i = 0
+      while (true) {
+        const l = 2 * i + 1
+        const r = l + 1
+        let min = i
+        if (l < items.length && this.compare(items[l], items[min]) < 0) min = l
+        if (r < items.length && this.compare(items[r], items[min]) < 0) min = r
+        if (min === i) break
+        ;[items[i], items[min]] = [items[min], items[i]]
+        i = min
+      }
+    }
+    return top
+  }
+}
+
+class ExternalSort {
+  constructor (spec, maxRows) {
+    this.compare = compileComparator(spec)
+    this.maxRows = maxRows || 200000
+    this.rows = []
+    this.runs = []
+    this.rowSize = 0
+  }
+
+  get overBudget () {
+    return this.rows.length >= this.maxRows
+  }
+
+  // Estimated bytes of the buffered rows, sized after the first one
+  get size () {
+    return this.rows.length * this.rowSize
+  }
+
+  add (row) {
+    if (!this.rowSize) this.rowSize = recordSize(row)
+    this.rows.push(row)
+  }
+
+  async spill () {
+    this.rows.sort(this.compare)
+    const run = await createSpillFile('sort')
+    for (let i = 0; i < this.rows.length; i += OUTPUT_SIZE) {
+      await run.append(this.rows.slice(i, i + OUTPUT_SIZE).map(row => JSON.stringify(row)))
+    }
+    await run.close()
+    this.runs.push(run)
+    this.rows = []
+  }
+
+  // Yields sorted rows in arrays of OUTPUT_SIZE
+  async * results () {
+    if (!this.runs.length) {
+      this.rows.sort(this.compare)
+      for (let i = 0; i < this.rows.length; i += OUTPUT_SIZE) {
+        yield this.rows.slice(i, i + OUTPUT_SIZE)
+      }
+      this.rows = []
+      return
+    }
+    if (this.rows.length) {
+      await this.spill()
+    }
+    // Ties go to the earlier run, which keeps the sort stable
+    const heap = new MinHeap((a, b) => this.compare(a.row, b.row) || a.run - b.run)
+    const sources = this.runs.map(run => run.lines())
+    for (let i = 0; i < sources.length; i++) {
+      const next = await sources[i].next()
+      if (!next.done) heap.push({ row: JSON.parse(next.value), run: i })
+    }
+    let output = []
+    while (heap.size) {
+      const top = heap.pop()
+      output.push(top.row)
+      const next = await sources[top.run].next()
+      if (!next.done) heap.push({ row: JSON.parse(next.value), run: top.run })
+      if (output.length >= OUTPUT_SIZE) {
+        yield output
+        output = []
+      }
+    }
+    if (output.length) {
+      yield output
+    }
+    await this.remove()
+  }
+
+  // Drops the buffered rows and the spilled runs, also for sorts stopped before their results
+  async remove () {
+    const runs = this.runs
+    this.runs = []
+    this.rows = []
+    for (const run of runs) {
+      await run.remove()
+    }
+  }
+}
+
+module.exports = {
+  compileComparator,
+  MinHeap,
+  ExternalSort
+}
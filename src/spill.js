@@ -0,0 +1,163 @@
+// Line-oriented temporary files for transforms that outgrow their memory budget.
+// Files live in the Origin Private File System when the platform has it, in memory otherwise.
+// They are named after the page or worker writing them, which holds a Web Lock of that name
+// while it lives, so a new run can remove what cancelled runs and closed tabs left behind.
+const SPILL_DIRECTORY = 'tranfi-spill'
+const READ_SIZE = 1024 * 1024
+const SESSION = Date.now().toString(36) + Math.random().toString(36).slice(2, 8)
+const SESSION_LOCK = `${SPILL_DIRECTORY}-${SESSION}`
+
+let spillCounter = 0
+let sessionLock = null
+
+// Held until the page or worker goes away
+function holdSessionLock () {
+  if (sessionLock || typeof navigator === 'undefined' || !navigator.locks) return
+  sessionLock = navigator.locks.request(SESSION_LOCK, () => new Promise(() => {}))
+}
+
+async function getSpillDirectory () {
+  if (typeof navigator === 'undefined' || !navigator.storage || !navigator.storage.getDirectory) {
+    return null
+  }
+  try {
+    const root = await navigator.storage.getDirectory()
+    return await root.getDirectoryHandle(SPILL_DIRECTORY, { create: true })
+  } catch (err) {
+    return null
+  }
+}
+
+// Yields the lines of a Blob without holding the whole file as one string
+async function * blobLines (blob) {
+  const decoder = new TextDecoder()
+  let partial = ''
+  for (let offset = 0; offset < blob.size; offset += READ_SIZE) {
+    const buffer = await blob.slice(offset, offset + READ_SIZE).arrayBuffer()
+    const lines = (partial + decoder.decode(buffer, { stream: true })).split('\n')
+    partial = lines.pop()
+    yield * lines
+  }
+  partial += decoder.decode()
+  if (partial) {
+    yield partial
+  }
+}
+
+class MemorySpillFile {
+  constructor () {
+    this.chunks = []
+    this.length = 0
+  }
+
+  async append (lines) {
+    this.chunks.push(lines)
+    this.length += lines.length
+  }
+
+  async close () {}
+
+  async * lines () {
+    for (const chunk of this.chunks) {
+      yield * chunk
+    }
+  }
+
+  async remove () {
+    this.chunks = []
+  }
+}
+
+// createWritable where available, sync access handles otherwise (dedicated workers only)
+class OPFSSpillFile {
+  constructor (directory, name, handle) {
+    this.directory = directory
+    this.name = name
+    this.handle = handle
+    this.writable = null
+    this.access = null
+    this.offset = 0
+    this.length = 0
+    this.encoder = new TextEncoder()
+  }
+
+  static async create (directory, name) {
+    const handle = await directory.getFileHandle(name, { create: true })
+    const file = new OPFSSpillFile(directory, name, handle)
+    if (handle.createWritable) {
+      file.writable = await handle.createWritable()
+    } else {
+      file.access = await handle.createSyncAccessHandle()
+    }
+    return file
+  }
+
+  async append (lines) {
+    const text = lines.join('\n') + '\n'
+    this.length += lines.length
+    if (this.writable) {
+      await this.writable.write(text)
+    } else {
+      this.offset += this.access.write(this.encoder.encode(text), { at: this.offset })
+    }
+  }
+
+  async close () {
+    if (this.writable) {
+      await this.writable.close()
+      this.writable = null
+    } else if (this.access) {
+      this.access.flush()
+      this.access.close()
+      this.access = null
+    }
+  }
+
+  async * lines () {
+    yield * blobLines(await this.handle.getFile())
+  }
+
+  async remove () {
+    if (this.removed) return
+    this.removed = true
+    await this.close()
+    await this.directory.removeEntry(this.name)
+  }
+}
+
+async function createSpillFile (prefix) {
+  const name = `${prefix}-${SESSION}-${spillCounter++}`
+  holdSessionLock()
+  const directory = await getSpillDirectory()
+  if (directory) {
+    try {
+      return await OPFSSpillFile.create(directory, name)
+    } catch (err) {
+      console.warn('OPFS spill failed, keeping spilled data in memory:', err.message)
+    }
+  }
+  return new MemorySpillFile()
+}
+
+// Called when a run starts: earlier runs of this page or worker are over, and files of sessions
+// no longer holding their lock belong to closed tabs. Without Web Locks only this session's go.
+async function clearSpills () {
+  const directory = await getSpillDirectory()
+  if (!directory) return
+  const held = navigator.locks ? new Set((await navigator.locks.query()).held.map(lock => lock.name)) : null
+  const names = []
+  for await (const name of directory.keys()) {
+    const session = name.split('-')[1]
+    if (session === SESSION || (held && !held.has(`${SPILL_DIRECTORY}-${session}`))) {
+      names.push(name)
+    }
+  }
+  // Files still open elsewhere cannot be removed, they go with a later run
+  await Promise.all(names.map(name => directory.removeEntry(name).catch(() => {})))
+}
+
+module.exports = {
+  blobLines,
+  createSpillFile,
+  clearSpills
+}
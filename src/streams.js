@@ -0,0 +1,235 @@
+const { Duplex, PassThrough, Writable } = require('stream')
+const through2 = require('through2')
+const { RecordBatch } = require('./batch')
+
+const NEWLINE = 0x0A
+
+// One duplex over a writable side and a readable side, errors of any stream destroy it
+// and their 'metadata' events are re-emitted on it
+function duplex (writable, readable, streams) {
+  const stream = new Duplex({
+    objectMode: true,
+    write (chunk, enc, callback) {
+      if (writable.write(chunk)) {
+        callback()
+      } else {
+        writable.once('drain', callback)
+      }
+    },
+    final (callback) {
+      writable.end()
+      callback()
+    },
+    read () {
+      readable.resume()
+    }
+  })
+  readable.on('data', chunk => {
+    if (!stream.push(chunk)) readable.pause()
+  })
+  readable.on('end', () => stream.push(null))
+  ;(streams || [writable, readable]).forEach(s => {
+    s.on('error', err => stream.destroy(err))
+    s.on('metadata', metadata => stream.emit('metadata', metadata))
+  })
+  return stream
+}
+
+// Wrap a chain of streams into one duplex: writes go to the first, reads come from the last
+function combine (first, ...rest) {
+  let last = first
+  for (const stream of rest) {
+    last = last.pipe(stream)
+  }
+  return duplex(first, last, [first, ...rest])
+}
+
+// Stage that consumes all input before producing output (sort, aggregation).
+// write(chunk) may return a promise to hold back input, e.g. while spilling.
+// results() is an async iterator of row arrays, pulled only as fast as downstream reads.
+// destroy(), when given, drops what the stage holds if it is destroyed first and may return a promise.
+function blocking ({ write, results, destroy }) {
+  let iterator = null
+  let reading = false
+  let wantMore = false
+
+  const pump = () => {
+    if (reading) {
+      wantMore = true
+      return
+    }
+    reading = true
+    wantMore = false
+    ;(async () => {
+      while (true) {
+        const { done, value } = await iterator.next()
+        if (done) {
+          stream.push(null)
+          return
+        }
+        let more = true
+        for (const row of value) {
+          more = stream.push(row)
+        }
+        if (!more) return
+      }
+    })().then(() => {
+      reading = false
+      if (wantMore) pump()
+    }, err => stream.destroy(err))
+  }
+
+  const stream = new Duplex({
+    objectMode: true,
+    write (chunk, enc, callback) {
+      const pending = write(chunk)
+      if (pending && pending.then) {
+        pending.then(() => callback(), callback)
+      } else {
+        callback()
+      }
+    },
+    final (callback) {
+      iterator = results()
+      callback()
+      if (wantMore) pump()
+    },
+    read () {
+      if (iterator) {
+        pump()
+      } else {
+        wantMore = true
+      }
+    },
+    destroy (err, callback) {
+      if (!destroy) return callback(err)
+      Promise.resolve(destroy()).then(() => callback(err), () => callback(err))
+    }
+  })
+  return stream
+}
+
+// Records in a chunk: batch rows, lines of text or bytes, or a single object
+function countRecords (chunk) {
+  if (RecordBatch.isBatch(chunk)) {
+    return chunk.length
+  } else if (typeof chunk === 'string' || chunk instanceof Uint8Array) {
+    const nl = typeof chunk === 'string' ? '\n' : NEWLINE
+    let n = 0
+    let i = chunk.indexOf(nl)
+    while (i !== -1) {
+      n += 1
+      i = chunk.indexOf(nl, i + 1)
+    }
+    return n
+  }
+  return 1
+}
+
+// Split a chunk after its first n records
+function splitRecords (chunk, n) {
+  if (RecordBatch.isBatch(chunk)) {
+    return [chunk.slice(0, n), chunk.slice(n, chunk.length)]
+  }
+  const nl = typeof chunk === 'string' ? '\n' : NEWLINE
+  let i = -1
+  for (let k = 0; k < n; k++) {
+    i = chunk.indexOf(nl, i + 1)
+  }
+  return typeof chunk === 'string'
+    ? [chunk.slice(0, i + 1), chunk.slice(i + 1)]
+    : [chunk.subarray(0, i + 1), chunk.subarray(i + 1)]
+}
+
+// Passes `limit` records and then holds the next chunk without calling back.
+// Upstream stages fill up to their highWaterMark and stop reading until more(n) is called.
+function gate (limit) {
+  let allowed = limit
+  let held = null
+
+  const pass = (chunk, callback) => {
+    const n = countRecords(chunk)
+    if (n <= allowed) {
+      allowed -= n
+      stream.push(chunk)
+      callback()
+      return
+    }
+    if (allowed > 0) {
+      const [head, rest] = splitRecords(chunk, allowed)
+      RecordBatch.release(chunk)
+      allowed = 0
+      stream.push(head)
+      chunk = rest
+      // Nothing left to hold back: an empty remainder or a trailing partial line
+      if (countRecords(chunk) === 0) {
+        if (chunk.length) {
+          stream.push(chunk)
+        } else {
+          RecordBatch.release(chunk)
+        }
+        callback()
+        return
+      }
+    }
+    held = { chunk, callback }
+    stream.emit('hold')
+  }
+
+  const stream = through2.obj(function (chunk, enc, callback) {
+    pass(chunk, callback)
+  })
+  stream.more = (n) => {
+    allowed += n
+    if (held) {
+      const { chunk, callback } = held
+      held = null
+      pass(chunk, callback)
+    }
+  }
+  return stream
+}
+
+// Copies every chunk of source to n readable branches, each buffering on its own.
+// The source is read again once every branch that refused a chunk has drained,
+// so a stalled branch holds back the shared stages but never makes another one drop data.
+// Chunks are shared, branches must not modify them; pooled batches get a reference per branch.
+function tee (source, n) {
+  const branches = []
+  for (let i = 0; i < n; i++) {
+    branches.push(new PassThrough({ objectMode: true }))
+  }
+  const sink = new Writable({
+    objectMode: true,
+    write (chunk, enc, callback) {
+      let waiting = 0
+      for (let i = 0; i < branches.length; i++) {
+        const branch = branches[i]
+        const copy = i > 0 && RecordBatch.isBatch(chunk) ? chunk.share(chunk.columns, chunk.length) : chunk
+        if (!branch.write(copy)) {
+          waiting += 1
+          branch.once('drain', () => {
+            if (--waiting === 0) callback()
+          })
+        }
+      }
+      if (waiting === 0) callback()
+    },
+    final (callback) {
+      branches.forEach(branch => branch.end())
+      callback()
+    }
+  })
+  source.on('error', err => branches.forEach(branch => branch.destroy(err)))
+  source.pipe(sink)
+  return branches
+}
+
+module.exports = {
+  duplex,
+  combine,
+  blocking,
+  countRecords,
+  gate,
+  tee
+}
@@ -0,0 +1,236 @@
+// Thrift compact protocol, the encoding of Parquet metadata. Structs are read generically
+// into objects keyed by field id, binary fields stay Uint8Array since Parquet uses them for raw statistics.
+const STOP = 0
+const TRUE = 1
+const FALSE = 2
+const BYTE = 3
+const I16 = 4
+const I32 = 5
+const I64 = 6
+const DOUBLE = 7
+const BINARY = 8
+const LIST = 9
+const SET = 10
+const MAP = 11
+const STRUCT = 12
+
+const encoder = new TextEncoder()
+
+class CompactReader {
+  constructor (bytes, pos) {
+    this.bytes = bytes
+    this.view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+    this.pos = pos || 0
+  }
+
+  byte () {
+    if (this.pos >= this.bytes.length) {
+      throw new Error('Truncated Thrift data')
+    }
+    return this.bytes[this.pos++]
+  }
+
+  // Unsigned varint as a number, exact up to 2^53
+  varint () {
+    let result = 0
+    let scale = 1
+    let b
+    do {
+      b = this.byte()
+      result += (b & 0x7f) * scale
+      scale *= 128
+    } while (b & 0x80)
+    return result
+  }
+
+  zigzag () {
+    const n = this.varint()
+    return n % 2 ? -(n + 1) / 2 : n / 2
+  }
+
+  binary () {
+    const length = this.varint()
+    const start = this.pos
+    this.pos += length
+    return this.bytes.subarray(start, this.pos)
+  }
+
+  value (type) {
+    switch (type) {
+      case TRUE: return true
+      case FALSE: return false
+      case BYTE: return (this.byte() << 24) >> 24
+      case I16:
+      case I32:
+      case I64: return this.zigzag()
+      case DOUBLE: {
+        const v = this.view.getFloat64(this.pos, true)
+        this.pos += 8
+        return v
+      }
+      case BINARY: return this.binary()
+      case LIST:
+      case SET: return this.list()
+      case MAP: return this.map()
+      case STRUCT: return this.struct()
+    }
+    throw new Error(`Unknown Thrift type ${type}`)
+  }
+
+  list () {
+    const header = this.byte()
+    const type = header & 0x0f
+    const size = (header >> 4) === 15 ? this.varint() : header >> 4
+    const items = new Array(size)
+    for (let i = 0; i < size; i++) {
+      // Booleans in containers take a byte each
+      items[i] = type === TRUE || type === FALSE ? this.byte() === TRUE : this.value(type)
+    }
+    return items
+  }
+
+  map () {
+    const size = this.varint()
+    const entries = new Map()
+    if (size === 0) return entries
+    const types = this.byte()
+    for (let i = 0; i < size; i++) {
+      entries.set(this.value(types >> 4), this.value(types & 0x0f))
+    }
+    return entries
+  }
+
+  struct () {
+    const fields = {}
+    let id = 0
+    while (true) {
+      const header = this.byte()
+      if (header === STOP) return fields
+      const delta = header >> 4
+      id = delta ? id + delta : this.zigzag()
+      fields[id] = this.value(header & 0x0f)
+    }
+  }
+}
+
+// Typed values for the writer, structs are objects of field id to typed value
+const T = {
+  bool: (value) => ({ type: value ? TRUE : FALSE, value }),
+  i32: (value) => ({ type: I32, value }),
+  i64: (value) => ({ type: I64, value }),
+  binary: (value) => ({ type: BINARY, value }),
+  string: (value) => ({ type: BINARY, value: encoder.encode(value) }),
+  list: (type, items) => ({ type: LIST, value: { type, items } }),
+  struct: (fields) => ({ type: STRUCT, value: fields })
+}
+
+class CompactWriter {
+  constructor () {
+    this.bytes = new Uint8Array(256)
+    this.pos = 0
+  }
+
+  reserve (n) {
+    if (this.pos + n <= this.bytes.length) return
+    let size = this.bytes.length * 2
+    while (size < this.pos + n) size *= 2
+    const bytes = new Uint8Array(size)
+    bytes.set(this.bytes.subarray(0, this.pos))
+    this.bytes = bytes
+  }
+
+  byte (b) {
+    this.reserve(1)
+    this.bytes[this.pos++] = b
+  }
+
+  varint (n) {
+    while (n >= 0x80) {
+      this.byte((n % 128) | 0x80)
+      n = Math.floor(n / 128)
+    }
+    this.byte(n)
+  }
+
+  zigzag (n) {
+    this.varint(n < 0 ? -2 * n - 1 : 2 * n)
+  }
+
+  value (type, value) {
+    switch (type) {
+      case TRUE:
+      case FALSE: return
+      case BYTE: return this.byte(value & 0xff)
+      case I16:
+      case I32:
+      case I64: return this.zigzag(value)
+      case DOUBLE: {
+        this.reserve(8)
+        new DataView(this.bytes.buffer).setFloat64(this.pos, value, true)
+        this.pos += 8
+        return
+      }
+      case BINARY: {
+        this.varint(value.length)
+        this.reserve(value.length)
+        this.bytes.set(value, this.pos)
+        this.pos += value.length
+        return
+      }
+      case LIST: return this.list(value.type, value.items)
+      case STRUCT: return this.struct(value)
+    }
+    throw new Error(`Unknown Thrift type ${type}`)
+  }
+
+  // Items are plain values of the element type, or typed values for structs
+  list (type, items) {
+    if (items.length < 15) {
+      this.byte((items.length << 4) | type)
+    } else {
+      this.byte(0xf0 | type)
+      this.varint(items.length)
+    }
+    items.forEach(item => this.value(type, type === STRUCT ? item.value : item))
+  }
+
+  struct (fields) {
+    let last = 0
+    Object.keys(fields).map(Number).sort((a, b) => a - b).forEach(id => {
+      const field = fields[id]
+      if (typeof field === 'undefined' || field === null) return
+      const delta = id - last
+      if (delta > 0 && delta < 16) {
+        this.byte((delta << 4) | field.type)
+      } else {
+        this.byte(field.type)
+        this.zigzag(id)
+      }
+      last = id
+      this.value(field.type, field.value)
+    })
+    this.byte(STOP)
+  }
+
+  finish () {
+    return this.bytes.slice(0, this.pos)
+  }
+}
+
+// Bytes of one struct
+function encodeStruct (fields) {
+  const writer = new CompactWriter()
+  writer.struct(fields)
+  return writer.finish()
+}
+
+module.exports = {
+  I32,
+  I64,
+  BINARY,
+  STRUCT,
+  T,
+  CompactReader,
+  CompactWriter,
+  encodeStruct
+}
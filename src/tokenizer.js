@@ -0,0 +1,294 @@
+// Byte-level CSV tokenizer for plain dialects: one-byte delimiter, double quotes, \n or \r\n lines.
+// A small WASM kernel finds the structural bytes (delimiter, quote, newline) 16 at a time with SIMD compares,
+// the JS side walks those positions to split records and decodes only the columns that are used.
+const QUOTE = 0x22
+const NEWLINE = 0x0A
+const RETURN = 0x0D
+const SPACE = 0x20
+const TAB = 0x09
+
+// Bytes scanned per kernel call, the position buffer needs four bytes per scanned byte at worst
+const BLOCK = 1024 * 1024
+const PAGE = 64 * 1024
+
+// (func (export "scan") (param $ptr i32) (param $len i32) (param $out i32) (param $delim i32) (result i32)
+//   16-byte blocks: mask = i8x16.bitmask(eq(v, delim) | eq(v, '"') | eq(v, '\n'))
+//   and every set bit is stored as ptr-relative i32 positions at $out with i32.ctz, mask &= mask - 1;
+//   the tail is scanned one byte at a time. Returns the number of positions written.)
+// Exports its memory, input goes at 0 and positions at BLOCK.
+const KERNEL = 'AGFzbQEAAAABCQFgBH9/f38BfwMCAQAFAwEAAQcRAgZtZW1vcnkCAARzY2FuAAAK3AEB2QEGAX8BfwF/AX8BfwR7IAP9DyEJQSL9DyEKQQr9DyELIAFBEGshBwJAA0AgBCAHSg0BIAAgBGr9AAAAIQwgDCAJ/SMgDCAK/SP9UCAMIAv9I/1Q/WQhBQJAA0AgBUUNASACIAZBBGxqIAQgBWhqNgIAIAZBAWohBiAFIAVBAWtxIQUMAAsLIARBEGohBAwACwsCQANAIAQgAU8NASAAIARqLQAAIgggA0YgCEEiRnIgCEEKRnIEQCACIAZBBGxqIAQ2AgAgBkEBaiEGCyAEQQFqIQQMAAsLIAYL'
+
+let kernel = null
+
+// The module is well under 4KB so it can be compiled synchronously on the main thread too.
+// Engines without WASM SIMD fail validation and use the scalar scan below.
+function loadKernel () {
+  if (kernel !== null) return kernel
+  kernel = false
+  try {
+    const bytes = Buffer.from(KERNEL, 'base64')
+    if (typeof WebAssembly === 'object' && WebAssembly.validate(bytes)) {
+      const instance = new WebAssembly.Instance(new WebAssembly.Module(bytes))
+      const memory = instance.exports.memory
+      memory.grow(Math.ceil(5 * BLOCK / PAGE) - memory.buffer.byteLength / PAGE)
+      kernel = {
+        scan: instance.exports.scan,
+        input: new Uint8Array(memory.buffer, 0, BLOCK),
+        positions: new Int32Array(memory.buffer, BLOCK, BLOCK)
+      }
+    }
+  } catch (err) {
+    kernel = false
+  }
+  return kernel
+}
+
+let scalarPositions = null
+
+// Structural byte positions of buf[from, from + BLOCK), relative to `from`, as [positions, count]
+function scanBlock (buf, from, delimiter) {
+  const end = Math.min(from + BLOCK, buf.length)
+  const k = loadKernel()
+  if (k) {
+    k.input.set(buf.subarray(from, end))
+    return [k.positions, k.scan(0, end - from, BLOCK, delimiter)]
+  }
+  if (scalarPositions === null) scalarPositions = new Int32Array(BLOCK)
+  let n = 0
+  for (let i = from; i < end; i++) {
+    const b = buf[i]
+    if (b === delimiter || b === QUOTE || b === NEWLINE) {
+      scalarPositions[n++] = i - from
+    }
+  }
+  return [scalarPositions, n]
+}
+
+const textDecoder = new TextDecoder()
+const textEncoder = new TextEncoder()
+
+// Short ASCII fields are built directly, anything else goes through TextDecoder
+function decode (buf, start, end) {
+  if (end - start > 32) {
+    return textDecoder.decode(buf.subarray(start, end))
+  }
+  let s = ''
+  for (let i = start; i < end; i++) {
+    const c = buf[i]
+    if (c > 0x7f) return textDecoder.decode(buf.subarray(start, end))
+    s += String.fromCharCode(c)
+  }
+  return s
+}
+
+const isBlank = (b) => b === SPACE || b === TAB
+
+class CSVTokenizer {
+  constructor (options = {}) {
+    this.delimiter = (options.delimiter || ',').charCodeAt(0)
+    this.trim = !!options.trim
+    this.skipEmptyLines = !!options.skipEmptyLines
+    this.comment = options.comment ? options.comment.charCodeAt(0) : -1
+    this.mask = null
+    this.carry = null
+  }
+
+  // Dialects the tokenizer covers, exotic ones stay on csv-parse
+  static supports (options) {
+    const d = options.delimiter || ','
+    const c = d.charCodeAt(0)
+    return d.length === 1 && c < 0x80 && c !== QUOTE && c !== NEWLINE && c !== RETURN &&
+      (!options.comment || (options.comment.length === 1 && options.comment.charCodeAt(0) < 0x80))
+  }
+
+  static fromParseOptions (options) {
+    return new CSVTokenizer({
+      delimiter: options.delimiter,
+      trim: options.trim,
+      skipEmptyLines: options.skip_empty_lines,
+      comment: options.comment
+    })
+  }
+
+  // Only these column indices are decoded, the rest are left undefined
+  columns (indices) {
+    if (indices === null) {
+      this.mask = null
+      return
+    }
+    this.mask = []
+    indices.forEach(i => { this.mask[i] = true })
+  }
+
+  // Calls emit with the string values of every complete record
+  write (chunk, emit) {
+    if (typeof chunk === 'string') {
+      chunk = textEncoder.encode(chunk)
+    }
+    let buf = chunk
+    if (this.carry) {
+      buf = new Uint8Array(this.carry.length + chunk.length)
+      buf.set(this.carry)
+      buf.set(chunk, this.carry.length)
+    }
+    const consumed = this.tokenize(buf, false, emit)
+    this.carry = consumed < buf.length ? buf.slice(consumed) : null
+  }
+
+  end (emit) {
+    if (this.carry) {
+      this.tokenize(this.carry, true, emit)
+      this.carry = null
+    }
+  }
+
+  field (buf, start, end, quoteStart, quoteEnd, escaped, column) {
+    if (this.mask !== null && !this.mask[column]) {
+      return undefined
+    }
+    if (quoteStart !== -1) {
+      const value = decode(buf, quoteStart + 1, quoteEnd)
+      return escaped ? value.replace(/""/g, '"') : value
+    }
+    if (this.trim) {
+      while (start < end && isBlank(buf[start])) start++
+      while (end > start && isBlank(buf[end - 1])) end--
+    }
+    return decode(buf, start, end)
+  }
+
+  // Emits the records in buf and returns the offset of the first byte not consumed.
+  // When `final` is false an unterminated last record is left for the next call.
+  // An unquoted comment char ends the record, the rest of the line is skipped,
+  // and a line with nothing before its comment is not emitted at all.
+  tokenize (buf, final, emit) {
+    const delimiter = this.delimiter
+    const n = buf.length
+    let recordStart = 0
+    let fieldStart = 0
+    let quoteStart = -1
+    let quoteEnd = -1
+    let escaped = false
+    let inQuotes = false
+    // Second quote of an escaped pair, which may sit in the next block
+    let skip = -1
+    let comment = false
+    // Start of the unquoted bytes of the current field, where a comment char counts
+    let plain = 0
+    let values = []
+    // Comment chars are not structural bytes, they are found with indexOf between them
+    const commentChar = this.comment
+    let nextComment = commentChar === -1 ? -1 : buf.indexOf(commentChar)
+    const commentBefore = (end) => {
+      if (nextComment !== -1 && nextComment < plain) nextComment = buf.indexOf(commentChar, plain)
+      return nextComment !== -1 && nextComment < end ? nextComment : -1
+    }
+
+    const endRecord = (end) => {
+      if (!comment) {
+        let last = end
+        if (quoteStart === -1 && last > fieldStart && buf[last - 1] === RETURN) last--
+        const empty = values.length === 0 && quoteStart === -1 && last === recordStart
+        if (!(empty && this.skipEmptyLines)) {
+          values.push(this.field(buf, fieldStart, last, quoteStart, quoteEnd, escaped, values.length))
+          emit(values)
+        }
+      }
+      values = []
+      quoteStart = -1
+      escaped = false
+    }
+
+    const startComment = (c) => {
+      let i = fieldStart
+      while (this.trim && i < c && isBlank(buf[i])) i++
+      if (values.length || quoteStart !== -1 || i < c) {
+        endRecord(c)
+        // Emitted, a carried rest of the line is only the comment
+        recordStart = c
+      }
+      comment = true
+    }
+
+    for (let block = 0; block < n; block += BLOCK) {
+      const [positions, count] = scanBlock(buf, block, delimiter)
+      for (let k = 0; k < count; k++) {
+        const p = block + positions[k]
+        if (p === skip) {
+          continue
+        }
+        const b = buf[p]
+        if (comment) {
+          if (b === NEWLINE) {
+            recordStart = fieldStart = plain = p + 1
+            comment = false
+          }
+          continue
+        }
+        if (!inQuotes && nextComment !== -1) {
+          const c = commentBefore(p)
+          if (c !== -1) {
+            startComment(c)
+            if (b === NEWLINE) {
+              recordStart = fieldStart = plain = p + 1
+              comment = false
+            }
+            continue
+          }
+        }
+        if (b === QUOTE) {
+          if (inQuotes) {
+            if (p + 1 === n && !final) {
+              return recordStart
+            }
+            if (buf[p + 1] === QUOTE) {
+              escaped = true
+              skip = p + 1
+              continue
+            }
+            inQuotes = false
+            quoteEnd = p
+            plain = p + 1
+          } else if (quoteStart === -1) {
+            let i = fieldStart
+            while (this.trim && i < p && isBlank(buf[i])) i++
+            if (i === p) {
+              inQuotes = true
+              quoteStart = p
+            }
+          }
+          continue
+        }
+        if (inQuotes) {
+          continue
+        }
+        if (b === delimiter) {
+          values.push(this.field(buf, fieldStart, p, quoteStart, quoteEnd, escaped, values.length))
+          fieldStart = plain = p + 1
+          quoteStart = -1
+          escaped = false
+          continue
+        }
+        endRecord(p)
+        recordStart = fieldStart = plain = p + 1
+      }
+    }
+    if (!final) {
+      return recordStart
+    }
+    // Last line without a newline, unbalanced quotes are dropped like skip_lines_with_error does
+    if (recordStart < n && !inQuotes && !comment) {
+      const c = nextComment === -1 ? -1 : commentBefore(n)
+      if (c !== -1) {
+        startComment(c)
+      } else {
+        endRecord(n)
+      }
+    }
+    return n
+  }
+}
+
+module.exports = {
+  CSVTokenizer
+}
@@ -1,8 +1,32 @@
+const fs = require('fs')
 const ReadStream = require('filestream').read
 const ParseStream = require('csv-parse')
 const JSONStream = require('JSONStream')
 const HTTPStream = require('stream-http')
 const through2 = require('through2')
+const { ParallelCSVStream } = require('./parallel-csv')
+const { ParallelNDJSONStream } = require('./parallel-ndjson')
+const { NDJSONStream } = require('./ndjson')
+const { BlobReadStream, HTTPRangeStream, SampleReadStream } = require('./readers')
+const { DecompressStream } = require('./decompress')
+const { columnarStream } = require('./columnar')
+const { readArrow, ArrowSerializer } = require('./arrow')
+const { readParquet, ParquetSerializer } = require('./parquet')
+const { BatchStore, RecordBatch } = require('./batch')
+const { BufferPool } = require('./pool')
+const { combine, blocking } = require('./streams')
+const { RowAssembler, pick } = require('./rows')
+const { CSVTokenizer } = require('./tokenizer')
+const { parseAggregates, HashAggregation } = require('./aggregate')
+const { ExternalSort } = require('./sort')
+const {
+  expressionFields, compileRecordFilter, compileBatchFilter, andExpressions,
+  parseAssignments, compileRecordMap, compileBatchMap
+} = require('./expr')
+const { loadIndex } = require('./join')
+const { stageKeys } = require('./cache')
+const { TextView, TableView } = require('./views')
+const { toText, isNode, stdoutStream, NDJSONSerializer, CSVSerializer, openSink, FileWriter } = require('./writers')
 
 let FileLoader = class FileLoader {
   static inputType = 'text'
@@ -12,9 +36,32 @@ let FileLoader = class FileLoader {
   static type = 'loader'
 
   static initStream (params) {
-    const stream = new ReadStream(params['File'], {chunkSize: params['Chunk size']})
-    stream.setEncoding('utf8')
-    // if (params['Encoding'] === 'UTF-8') {}
+    // A path instead of a File in headless runs
+    if (typeof params['File'] === 'string') {
+      const stream = fs.createReadStream(params['File'], { highWaterMark: 1024 * 1024 })
+      stream.size = fs.statSync(params['File']).size
+      if (params['Encoding'] === 'UTF-8') {
+        stream.setEncoding('utf8')
+      }
+      return stream
+    }
+    if (params['Sample']) {
+      const sample = new SampleReadStream(params['File'], {
+        rows: params['Sample rows'],
+        windows: params['Sample windows'],
+        header: params['Keep header']
+      })
+      if (params['Encoding'] === 'UTF-8') {
+        sample.setEncoding('utf8')
+      }
+      return sample
+    }
+    const stream = params['Adaptive chunk size']
+      ? new BlobReadStream(params['File'], {adaptive: true, targetLatency: params['Target latency (ms)']})
+      : new ReadStream(params['File'], {chunkSize: params['Chunk size']})
+    if (params['Encoding'] === 'UTF-8') {
+      stream.setEncoding('utf8')
+    }
     return stream
   }
 
@@ -22,8 +69,17 @@ let FileLoader = class FileLoader {
     this.name = this.constructor.name
     this.inputs = [
       { name: 'File', type: 'file' },
-      // { name: 'Encoding', type: 'categorical', options: ['UTF-8', 'Buffer'], default: 'UTF-8' },
+      // Binary keeps raw Uint8Array chunks, parsers decode only the fields they emit
+      { name: 'Encoding', type: 'categorical', options: ['Binary', 'UTF-8'], default: 'Binary' },
+      // Fixed chunk size is used when adaptive sizing is off
+      { name: 'Adaptive chunk size', type: 'bool', default: true },
+      { name: 'Target latency (ms)', type: 'int', default: 50 },
       { name: 'Chunk size', type: 'int', default: 10000 },
+      // Preview from random windows of the file instead of its head
+      { name: 'Sample', type: 'bool', default: false },
+      { name: 'Sample rows', type: 'int', default: 1000 },
+      { name: 'Sample windows', type: 'int', default: 64 },
+      { name: 'Keep header', type: 'bool', default: true }
     ]
     this.inputType = this.constructor.inputType
     this.outputType = this.constructor.outputType
@@ -41,13 +97,27 @@ let HTTPLoader = class HTTPLoader {
   static type = 'loader'
 
   static initStream (params) {
-    return new Promise((resolve, reject) => {
-      HTTPStream.get(params['URL'], function (stream) {
+    if (params['Connections'] > 1) {
+      const stream = new HTTPRangeStream(params['URL'], {
+        concurrency: params['Connections'],
+        retries: params['Retries']
+      })
+      if (params['Encoding'] === 'UTF-8') {
         stream.setEncoding('utf8')
-        // if (params['Encoding'] === 'UTF-8') {}
-        // stream.setEncoding(params['Encoding'] === 'UTF-8' ? 'utf8' : 'buffer')
+      }
+      return stream
+    }
+    return new Promise((resolve, reject) => {
+      const req = HTTPStream.get(params['URL'], function (stream) {
+        if (stream.headers['content-length']) {
+          stream.size = Number(stream.headers['content-length'])
+        }
+        if (params['Encoding'] === 'UTF-8') {
+          stream.setEncoding('utf8')
+        }
         resolve(stream)
       })
+      req.on('error', reject)
     })
   }
 
@@ -55,7 +125,11 @@ let HTTPLoader = class HTTPLoader {
     this.name = this.constructor.name
     this.inputs = [
       { name: 'URL', type: 'string' },
-      // { name: 'Encoding', type: 'categorical', options: ['UTF-8', 'Buffer'], default: 'UTF-8' },
+      // More than one connection fetches byte ranges concurrently, retrying failed ranges
+      { name: 'Connections', type: 'int', default: 1 },
+      { name: 'Retries', type: 'int', default: 3 },
+      // Binary keeps raw Uint8Array chunks, parsers decode only the fields they emit
+      { name: 'Encoding', type: 'categorical', options: ['Binary', 'UTF-8'], default: 'Binary' },
     ]
     this.inputType = this.constructor.inputType
     this.outputType = this.constructor.outputType
@@ -65,6 +139,33 @@ let HTTPLoader = class HTTPLoader {
   }
 }
 
+let Decompress = class Decompress {
+  static inputType = 'binary'
+
+  // Decompressed bytes, text parsers decode them like a loader's binary chunks
+  static outputType = 'binary'
+
+  static type = 'decoder'
+
+  static initStream (params) {
+    return new DecompressStream(params['Format'], params['Entry'])
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      { name: 'Format', type: 'categorical', options: ['Auto', 'Gzip', 'Zip'], default: 'Auto' },
+      // Zip entry path, first file in the archive when empty
+      { name: 'Entry', type: 'string' },
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = []
+  }
+}
+
 let CSVParser = class CSVParser {
   static inputType = 'text'
 
@@ -72,8 +173,8 @@ let CSVParser = class CSVParser {
 
   static type = 'parser'
 
-  static initStream (params) {
-     const stream = ParseStream({
+  static options (params) {
+    return {
       'delimiter': params['Delimiter'],
       'cast': true,
       'columns': true,
@@ -82,16 +183,128 @@ let CSVParser = class CSVParser {
       'relax_column_count': true,
       'skip_empty_lines': params['Skip empty lines'],
       'skip_lines_with_error': true
+    }
+  }
+
+  // Parallel mode reads the file itself instead of the loader's text stream, unless the loader samples it
+  static fuse (prev, stage) {
+    if (stage.params['Parallel'] && prev.name === 'FileLoader' && !prev.params['Sample']) {
+      return {
+        name: stage.name,
+        params: Object.assign({}, stage.params, { 'File': prev.params['File'] })
+      }
+    }
+  }
+
+  static getOutputType (params) {
+    return params['Output'] === 'Batches' ? 'batch' : 'object'
+  }
+
+  // Inferred schemas are reported as stream metadata for the pipeline card
+  static withMetadata (stream, options) {
+    return Object.assign({}, options, { onSchema: (schema) => stream.emit('metadata', { schema }) })
+  }
+
+  // Value arrays from csv-parse, header first, to objects or batches
+  static recordStream (options) {
+    let assembler = null
+    const push = (chunk) => stream.push(chunk)
+    const stream = through2.obj(function (values, enc, callback) {
+      if (assembler === null) {
+        assembler = new RowAssembler(values, CSVParser.withMetadata(stream, options))
+      } else {
+        assembler.write(values, push)
+      }
+      callback()
+    }, function (callback) {
+      if (assembler) {
+        assembler.end(push)
+      }
+      callback()
+    })
+    return stream
+  }
+
+  // Byte tokenizer in place of csv-parse, header first like recordStream
+  static tokenizerStream (params, options) {
+    const tokenizer = CSVTokenizer.fromParseOptions(CSVParser.options(params))
+    let assembler = null
+    const push = (chunk) => stream.push(chunk)
+    const write = (values) => {
+      if (assembler === null) {
+        assembler = new RowAssembler(values, CSVParser.withMetadata(stream, options))
+        tokenizer.columns(assembler.castIndices)
+      } else {
+        assembler.write(values, push)
+      }
+    }
+    const stream = through2.obj(function (chunk, enc, callback) {
+      tokenizer.write(chunk, write)
+      callback()
+    }, function (callback) {
+      tokenizer.end(write)
+      if (assembler) {
+        assembler.end(push)
+      }
+      callback()
     })
     return stream
   }
 
+  static fast (params) {
+    return params['Engine'] === 'Fast' && CSVTokenizer.supports(CSVParser.options(params))
+  }
+
+  // params['Filter'] and params['Fields'] are set by the planner
+  // when a filter or a projection downstream is pushed into the parser
+  static initStream (params) {
+    const rowOptions = {
+      batchSize: params['Output'] === 'Batches' ? params['Batch size'] : 0,
+      filter: params['Filter'],
+      fields: params['Fields'],
+      sample: params['Schema'] === 'Infer' ? params['Sample rows'] : 0
+    }
+    if (params['File']) {
+      return new ParallelCSVStream(params['File'], CSVParser.options(params), {
+        workers: params['Workers'],
+        rangeSize: 16 * 1024 * 1024,
+        quotedNewlines: params['Quoted newlines'],
+        engine: CSVParser.fast(params) ? 'Fast' : 'csv-parse',
+        rows: rowOptions
+      })
+    }
+    // Batch buffers are pooled on this thread only, parallel workers transfer theirs
+    if (rowOptions.batchSize && params['Reuse buffers']) {
+      rowOptions.pool = new BufferPool()
+    }
+    if (CSVParser.fast(params)) {
+      return CSVParser.tokenizerStream(params, rowOptions)
+    }
+    if (rowOptions.batchSize || rowOptions.filter || rowOptions.fields || rowOptions.sample) {
+      // Raw string arrays, RowAssembler casts only the columns it uses
+      const options = Object.assign(CSVParser.options(params), { 'columns': false, 'cast': false })
+      return combine(ParseStream(options), CSVParser.recordStream(rowOptions))
+    }
+    const stream = ParseStream(CSVParser.options(params))
+    return stream
+  }
+
   constructor (id) {
     this.name = this.constructor.name
     this.inputs = [
       { name: 'Delimiter', type: 'string', default: ',' },
+      { name: 'Engine', type: 'categorical', options: ['csv-parse', 'Fast'], default: 'csv-parse' },
       { name: 'Trim', type: 'bool', default: true },
-      { name: 'Skip empty lines', type: 'bool', default: true }
+      { name: 'Skip empty lines', type: 'bool', default: true },
+      { name: 'Schema', type: 'categorical', options: ['Infer', 'Per value'], default: 'Infer' },
+      { name: 'Sample rows', type: 'int', default: 1000 },
+      { name: 'Output', type: 'categorical', options: ['Objects', 'Batches'], default: 'Objects' },
+      { name: 'Batch size', type: 'int', default: 4096 },
+      // Recycle column buffers of batches released downstream, see pool.js
+      { name: 'Reuse buffers', type: 'bool', default: false },
+      { name: 'Parallel', type: 'bool', default: false },
+      { name: 'Workers', type: 'int', default: 0 },
+      { name: 'Quoted newlines', type: 'bool', default: true }
     ]
     this.inputType = this.constructor.inputType
     this.outputType = this.constructor.outputType
@@ -108,7 +321,32 @@ let JSONParser = class JSONParser {
 
   static type = 'parser'
 
+  // Parallel NDJSON reads the file itself, like the parallel CSV parser
+  static fuse (prev, stage) {
+    if (stage.params['Format'] === 'NDJSON' && stage.params['Parallel'] && prev.name === 'FileLoader' && !prev.params['Sample']) {
+      return {
+        name: stage.name,
+        params: Object.assign({}, stage.params, { 'File': prev.params['File'] })
+      }
+    }
+  }
+
+  // Path is only used for whole documents, NDJSON lines are emitted as they are
   static initStream (params) {
+    const fields = params['Fields']
+    if (params['Format'] === 'NDJSON') {
+      if (params['File']) {
+        return new ParallelNDJSONStream(params['File'], fields, {
+          workers: params['Workers'],
+          rangeSize: 16 * 1024 * 1024
+        })
+      }
+      return NDJSONStream(fields)
+    }
+    if (fields) {
+      // Keep only projected fields so the rest can be collected right away
+      return JSONStream.parse(params['Path'], (value) => pick(value, fields))
+    }
     const stream = JSONStream.parse(params['Path'])
     return stream
   }
@@ -117,6 +355,9 @@ let JSONParser = class JSONParser {
     this.name = this.constructor.name
     this.inputs = [
       { name: 'Path', type: 'string', default: '*' },
+      { name: 'Format', type: 'categorical', options: ['JSON', 'NDJSON'], default: 'JSON' },
+      { name: 'Parallel', type: 'bool', default: false },
+      { name: 'Workers', type: 'int', default: 0 }
     ]
     this.inputType = this.constructor.inputType
     this.outputType = this.constructor.outputType
@@ -126,6 +367,488 @@ let JSONParser = class JSONParser {
   }
 }
 
+// Columnar files are read by range from the loader's File, sampling windows of it don't apply.
+// Without one (HTTP, decompressed input) the loader's bytes are collected first.
+function fuseFile (prev, stage) {
+  if (prev.name === 'FileLoader' && prev.params['File']) {
+    return {
+      name: stage.name,
+      params: Object.assign({}, stage.params, { 'File': prev.params['File'] })
+    }
+  }
+}
+
+let ArrowParser = class ArrowParser {
+  static inputType = 'binary'
+
+  static outputType = 'batch'
+
+  static type = 'parser'
+
+  static fuse (prev, stage) {
+    return fuseFile(prev, stage)
+  }
+
+  // params['Fields'] is set by the planner, only those columns' buffers are read
+  static initStream (params) {
+    return columnarStream(params['File'], (source, emitMetadata) => readArrow(source, emitMetadata, {
+      fields: params['Fields'],
+      batchSize: params['Batch size']
+    }))
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      { name: 'Batch size', type: 'int', default: 4096 }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = []
+  }
+}
+
+let ParquetParser = class ParquetParser {
+  static inputType = 'binary'
+
+  static outputType = 'batch'
+
+  static type = 'parser'
+
+  static fuse (prev, stage) {
+    return fuseFile(prev, stage)
+  }
+
+  // params['Fields'] and params['Filter'] are set by the planner: only those column chunks are read,
+  // and row groups whose statistics rule the filter out are skipped
+  static initStream (params) {
+    return columnarStream(params['File'], (source, emitMetadata) => readParquet(source, emitMetadata, {
+      fields: params['Fields'],
+      filter: params['Filter'],
+      batchSize: params['Batch size']
+    }))
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      { name: 'Batch size', type: 'int', default: 4096 }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = []
+  }
+}
+
+// Input defaults of a transform, for stages a transform runs internally
+function defaultParams (Transform, params) {
+  const defaults = {}
+  new Transform(0).inputs.forEach(input => {
+    if ('default' in input) defaults[input.name] = input.default
+  })
+  return Object.assign(defaults, params)
+}
+
+function splitFields (value) {
+  return (value || '').split(',').map(f => f.trim()).filter(f => f.length)
+}
+
+let Filter = class Filter {
+  static inputType = 'object'
+
+  static outputType = 'object'
+
+  static type = 'transform'
+
+  // Right after CSVParser the predicate runs on value arrays, before records are built,
+  // right after ParquetParser it also skips row groups by their statistics
+  static fuse (prev, stage) {
+    if ((prev.name === 'CSVParser' || prev.name === 'ParquetParser') && stage.params['Expression']) {
+      return {
+        name: prev.name,
+        params: Object.assign({}, prev.params, {
+          'Filter': andExpressions(prev.params['Filter'], stage.params['Expression'])
+        })
+      }
+    }
+  }
+
+  static requires (params, needed) {
+    return needed && params['Expression']
+      ? Array.from(new Set(needed.concat(expressionFields(params['Expression']))))
+      : needed
+  }
+
+  static initStream (params) {
+    if (!params['Expression']) {
+      return through2.obj()
+    }
+    const test = compileRecordFilter(params['Expression'])
+    const testBatch = compileBatchFilter(params['Expression'])
+    const stream = through2.obj(function (chunk, enc, callback) {
+      if (RecordBatch.isBatch(chunk)) {
+        const [selection, n] = testBatch(chunk)
+        if (n === chunk.length) {
+          this.push(chunk)
+        } else {
+          if (n > 0) this.push(chunk.select(selection, n))
+          RecordBatch.release(chunk)
+        }
+      } else if (test(chunk)) {
+        this.push(chunk)
+      }
+      callback()
+    })
+    return stream
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      // filtrex syntax, e.g. price > 10 and category in ("a", "b")
+      { name: 'Expression', type: 'string' }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = [0]
+  }
+}
+
+// Computed columns, e.g. total = price * quantity. Batches get new columns built in one loop per expression.
+let Compute = class Compute {
+  static inputType = 'object'
+
+  static outputType = 'object'
+
+  static type = 'transform'
+
+  // Assigned fields come from here, the fields the expressions read from upstream
+  static requires (params, needed) {
+    if (!needed) return null
+    const fields = new Set(needed)
+    parseAssignments(params['Columns']).reverse().forEach(a => {
+      fields.delete(a.name)
+      expressionFields(a.expression).forEach(f => fields.add(f))
+    })
+    return Array.from(fields)
+  }
+
+  static initStream (params) {
+    const assignments = parseAssignments(params['Columns'])
+    if (!assignments.length) {
+      return through2.obj()
+    }
+    const mapRecord = compileRecordMap(assignments)
+    const mapBatch = compileBatchMap(assignments)
+    const stream = through2.obj(function (chunk, enc, callback) {
+      if (RecordBatch.isBatch(chunk)) {
+        this.push(mapBatch(chunk))
+        RecordBatch.release(chunk)
+      } else {
+        this.push(mapRecord(chunk))
+      }
+      callback()
+    })
+    return stream
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      // name = filtrex expression, one per line or separated by semicolons
+      { name: 'Columns', type: 'string' }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = [0]
+  }
+}
+
+let Select = class Select {
+  static inputType = 'object'
+
+  static outputType = 'object'
+
+  static type = 'transform'
+
+  // Upstream stages only have to produce the selected fields
+  static requires (params, needed) {
+    const fields = splitFields(params['Fields'])
+    return fields.length ? fields : needed
+  }
+
+  static initStream (params) {
+    const fields = splitFields(params['Fields'])
+    if (!fields.length) {
+      return through2.obj()
+    }
+    const stream = through2.obj(function (chunk, enc, callback) {
+      if (RecordBatch.isBatch(chunk)) {
+        this.push(chunk.project(fields))
+        RecordBatch.release(chunk)
+      } else {
+        this.push(pick(chunk, fields))
+      }
+      callback()
+    })
+    return stream
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      // Comma-separated field names
+      { name: 'Fields', type: 'string' }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = [0]
+  }
+}
+
+let GroupBy = class GroupBy {
+  static inputType = 'object'
+
+  static outputType = 'object'
+
+  static type = 'transform'
+
+  static requires (params, needed) {
+    const fields = splitFields(params['Group by'])
+    parseAggregates(params['Aggregates']).forEach(a => {
+      if (a.field) fields.push(a.field)
+    })
+    return Array.from(new Set(fields))
+  }
+
+  static initStream (params, context) {
+    const aggregation = new HashAggregation(
+      splitFields(params['Group by']),
+      parseAggregates(params['Aggregates']),
+      params['Max groups']
+    )
+    const reservation = context.memory.register(context.name, () => aggregation.size, true)
+    return blocking({
+      write: (chunk) => {
+        if (RecordBatch.isBatch(chunk)) {
+          aggregation.addBatch(chunk)
+          RecordBatch.release(chunk)
+        } else {
+          aggregation.addRecord(chunk)
+        }
+        if (aggregation.overBudget || reservation.overBudget) {
+          return aggregation.spill()
+        }
+      },
+      results: () => reservation.releaseAfter(aggregation.results()),
+      destroy: () => {
+        reservation.release()
+        return aggregation.remove()
+      }
+    })
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      // Comma-separated key fields, a single group when empty
+      { name: 'Group by', type: 'string' },
+      // count, sum(x), min(x), max(x), mean(x), distinct(x), quantile(x, 0.95)
+      { name: 'Aggregates', type: 'string', default: 'count' },
+      // Groups held in memory before states are spilled to disk
+      { name: 'Max groups', type: 'int', default: 100000 }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = [0, 1]
+  }
+}
+
+let Sort = class Sort {
+  static inputType = 'object'
+
+  static outputType = 'object'
+
+  static type = 'transform'
+
+  static initStream (params, context) {
+    const sort = new ExternalSort(params['Sort by'] || '', params['Max rows in memory'])
+    const reservation = context.memory.register(context.name, () => sort.size, true)
+    const add = (row) => sort.add(row)
+    return blocking({
+      write: (chunk) => {
+        if (RecordBatch.isBatch(chunk)) {
+          chunk.toObjects().forEach(add)
+          RecordBatch.release(chunk)
+        } else {
+          add(chunk)
+        }
+        if (sort.overBudget || reservation.overBudget) {
+          return sort.spill()
+        }
+      },
+      results: () => reservation.releaseAfter(sort.results()),
+      destroy: () => {
+        reservation.release()
+        return sort.remove()
+      }
+    })
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      // Comma-separated fields, -field for descending
+      { name: 'Sort by', type: 'string' },
+      // Rows per sorted run spilled to disk
+      { name: 'Max rows in memory', type: 'int', default: 200000 }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = [0]
+  }
+}
+
+// Enriches every record with the matching rows of a lookup file, loaded and parsed like a pipeline of its own.
+// The lookup side is indexed in memory before the first record passes, lookup fields overwrite probe fields.
+let Join = class Join {
+  static inputType = 'object'
+
+  static outputType = 'object'
+
+  static type = 'transform'
+
+  // Fields added from the lookup side are asked from the parser too and come out null there
+  static requires (params, needed) {
+    return needed && params['Key'] ? Array.from(new Set(needed.concat(params['Key']))) : null
+  }
+
+  // Loader and parser streams with their defaults, Fast engine where the CSV options allow it.
+  // Arrow and Parquet lookups are read by range from the file, without a loader.
+  static lookupStream (params) {
+    const columnar = { 'Arrow': ArrowParser, 'Parquet': ParquetParser }[params['Format']]
+    if (columnar) {
+      return columnar.initStream(defaultParams(columnar, { 'File': params['Lookup file'] }))
+    }
+    const loader = FileLoader.initStream(defaultParams(FileLoader, { 'File': params['Lookup file'], 'Encoding': 'Binary' }))
+    const parser = params['Format'] === 'NDJSON'
+      ? JSONParser.initStream(defaultParams(JSONParser, { 'Format': 'NDJSON' }))
+      : CSVParser.initStream(defaultParams(CSVParser, { 'Delimiter': params['Delimiter'], 'Engine': 'Fast' }))
+    loader.on('error', err => parser.destroy(err))
+    return loader.pipe(parser)
+  }
+
+  static async initStream (params, context) {
+    if (!params['Lookup file'] || !params['Key']) {
+      throw new Error('Join needs a lookup file and a key')
+    }
+    const key = params['Key']
+    const range = params['Match'] === 'Range' ? splitFields(params['Range fields']) : null
+    if (range && range.length !== 2) {
+      throw new Error('Range joins need the lookup fields of range start and end, e.g. from, to')
+    }
+    const options = {
+      key: params['Lookup key'] || key,
+      range,
+      prefix: params['Prefix'] || '',
+      budget: params['Memory (MB)'] * 1024 * 1024
+    }
+    const lookup = pick(params, ['Lookup file', 'Format', 'Delimiter', 'Match', 'Range fields', 'Prefix'])
+    const index = await loadIndex(stageKeys([{ name: 'Join', params: Object.assign({ key: options.key }, lookup) }])[0],
+      () => Join.lookupStream(params), options)
+    // Kept across runs, but only counted against the runs using it
+    const reservation = context.memory.register(context.name, () => index.size)
+
+    const inner = params['Type'] === 'Inner'
+    const probe = (stream, record) => {
+      const matches = index.match(record[key])
+      if (matches.length) {
+        for (const fields of matches) {
+          stream.push(Object.assign({}, record, fields))
+        }
+      } else if (!inner) {
+        stream.push(record)
+      }
+    }
+    const stream = through2.obj(function (chunk, enc, callback) {
+      if (RecordBatch.isBatch(chunk)) {
+        chunk.toObjects().forEach(record => probe(this, record))
+        RecordBatch.release(chunk)
+      } else {
+        probe(this, chunk)
+      }
+      callback()
+    }, function (callback) {
+      reservation.release()
+      callback()
+    })
+    return stream
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      { name: 'Lookup file', type: 'file' },
+      { name: 'Format', type: 'categorical', options: ['CSV', 'NDJSON', 'Arrow', 'Parquet'], default: 'CSV' },
+      { name: 'Delimiter', type: 'string', default: ',' },
+      // Probe field, and the lookup field it matches when named differently
+      { name: 'Key', type: 'string' },
+      { name: 'Lookup key', type: 'string' },
+      // Range matches Key against [from, to) of the two lookup fields
+      { name: 'Match', type: 'categorical', options: ['Equal', 'Range'], default: 'Equal' },
+      { name: 'Range fields', type: 'string' },
+      // Left keeps records without a match
+      { name: 'Type', type: 'categorical', options: ['Inner', 'Left'], default: 'Inner' },
+      { name: 'Prefix', type: 'string' },
+      { name: 'Memory (MB)', type: 'int', default: 256 }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = [0, 3]
+  }
+}
+
+// Starts a branch: every card after it, up to the next Branch, reads what the cards before the
+// first Branch produce. The shared part is loaded and parsed once for all branches.
+let Branch = class Branch {
+  static inputType = 'object'
+
+  static outputType = 'object'
+
+  static type = 'branch'
+
+  // Only marks where a branch starts, build() tees the stream instead
+  static initStream () {
+    return through2.obj()
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = []
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = []
+  }
+}
+
 let TextOutput = class TextOutput {
   static inputType = 'text'
 
@@ -134,20 +857,27 @@ let TextOutput = class TextOutput {
   static type = 'output'
 
   static initStream (params) {
-    const textOutput = document.getElementById('text-output')
-    textOutput.style.display = 'block'
-    textOutput.innerText = ''
-    const stream = through2(function (chunk, enc, callback) {
-      textOutput.innerText += chunk
+    if (isNode()) {
+      return stdoutStream()
+    }
+    const view = new TextView(document.getElementById('text-output'), params['Max lines'])
+    const decoder = new TextDecoder()
+    const stream = through2.obj(function (chunk, enc, callback) {
+      view.append(toText(chunk, decoder))
       this.push(chunk)
       callback()
+    }, function (callback) {
+      view.append(decoder.decode())
+      callback()
     })
     return stream
   }
 
   constructor (id) {
     this.name = this.constructor.name
-    this.inputs = []
+    this.inputs = [
+      { name: 'Max lines', type: 'int', default: 100000 }
+    ]
     this.inputType = this.constructor.inputType
     this.outputType = this.constructor.outputType
     this.id = id
@@ -155,12 +885,113 @@ let TextOutput = class TextOutput {
     this.displayInputs = []
   }
 }
+let TableOutput = class TableOutput {
+  static inputType = 'object'
+
+  static outputType = 'html'
+
+  static type = 'output'
+
+  static initStream (params) {
+    if (isNode()) {
+      return stdoutStream()
+    }
+    const store = new BatchStore(params['Max rows'])
+    const view = new TableView(
+      document.getElementById('table-output'),
+      document.getElementById('table-info'),
+      store
+    )
+    const stream = through2.obj(function (chunk, enc, callback) {
+      if (RecordBatch.isBatch(chunk)) {
+        store.seal()
+        store.add(RecordBatch.keep(chunk))
+      } else {
+        store.appendObject(chunk)
+      }
+      view.schedule()
+      this.push(chunk)
+      callback()
+    }, function (callback) {
+      view.schedule()
+      callback()
+    })
+    return stream
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      { name: 'Max rows', type: 'int', default: 1000000 }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = []
+  }
+}
+
+let FileOutput = class FileOutput {
+  static inputType = 'object'
+
+  static outputType = 'file'
+
+  static type = 'output'
+
+  static extensions = { 'CSV': 'csv', 'NDJSON': 'ndjson', 'Arrow': 'arrow', 'Parquet': 'parquet' }
+
+  // Asks for the target file, so it has to be built while the Run click still counts as a user gesture
+  static async initStream (params) {
+    const format = params['Format']
+    const name = params['File name'] || `output.${FileOutput.extensions[format]}`
+    const serializer = format === 'CSV' ? new CSVSerializer(params['Delimiter'])
+      : format === 'Arrow' ? new ArrowSerializer()
+        : format === 'Parquet' ? new ParquetSerializer()
+          : new NDJSONSerializer()
+    const writer = new FileWriter(serializer, await openSink(name, serializer.binary))
+    const stream = through2.obj(function (chunk, enc, callback) {
+      this.push(chunk)
+      writer.write(chunk).then(() => callback(), callback)
+    }, function (callback) {
+      writer.end().then(() => callback(), callback)
+    })
+    return stream
+  }
+
+  constructor (id) {
+    this.name = this.constructor.name
+    this.inputs = [
+      { name: 'Format', type: 'categorical', options: ['CSV', 'NDJSON', 'Arrow', 'Parquet'], default: 'CSV' },
+      { name: 'Delimiter', type: 'string', default: ',' },
+      { name: 'File name', type: 'string', default: '' }
+    ]
+    this.inputType = this.constructor.inputType
+    this.outputType = this.constructor.outputType
+    this.id = id
+    this.expanded = false
+    this.displayInputs = []
+  }
+}
+
 module.exports = {
   FileLoader,
   HTTPLoader,
+  Decompress,
   CSVParser,
   JSONParser,
-  TextOutput
+  ArrowParser,
+  ParquetParser,
+  Filter,
+  Compute,
+  Select,
+  GroupBy,
+  Sort,
+  Join,
+  Branch,
+  TextOutput,
+  TableOutput,
+  FileOutput
 }
 
 
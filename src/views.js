@@ -0,0 +1,153 @@
+// Virtualized DOM views for output transforms.
+// They keep a bounded store of rendered rows and only touch the DOM once per animation frame,
+// rendering just the rows visible in the scroll window.
+const LINE_HEIGHT = 16 // px, matches .virtual-view line-height in app.css
+const OVERSCAN = 20 // rows rendered above and below the visible window
+
+const requestFrame = typeof requestAnimationFrame !== 'undefined'
+  ? requestAnimationFrame
+  : (cb) => setTimeout(cb, 16)
+
+class VirtualView {
+  constructor (container) {
+    this.container = container
+    this.container.innerHTML = ''
+    this.container.style.display = 'block'
+    this.spacer = document.createElement('div')
+    this.container.appendChild(this.spacer)
+    this.scheduled = false
+    this.follow = true
+    this.container.onscroll = () => {
+      const c = this.container
+      this.follow = c.scrollTop + c.clientHeight >= c.scrollHeight - LINE_HEIGHT
+      this.schedule()
+    }
+  }
+
+  schedule () {
+    if (!this.scheduled) {
+      this.scheduled = true
+      requestFrame(() => {
+        this.scheduled = false
+        this.render()
+      })
+    }
+  }
+
+  // Visible row range for a given total number of rows
+  window (total) {
+    const first = Math.max(0, Math.floor(this.container.scrollTop / LINE_HEIGHT) - OVERSCAN)
+    const visible = Math.ceil(this.container.clientHeight / LINE_HEIGHT) + 2 * OVERSCAN
+    return [first, Math.min(total, first + visible)]
+  }
+
+  render () {
+    const total = this.size()
+    this.spacer.style.height = (total * LINE_HEIGHT) + 'px'
+    if (this.follow) {
+      this.container.scrollTop = this.container.scrollHeight
+    }
+    const [first, last] = this.window(total)
+    this.renderRows(first, last)
+  }
+}
+
+// Ring buffer of the last maxLines lines
+class TextView extends VirtualView {
+  constructor (container, maxLines) {
+    super(container)
+    this.pre = document.createElement('pre')
+    this.container.appendChild(this.pre)
+    this.capacity = maxLines || 100000
+    this.lines = new Array(this.capacity)
+    this.start = 0
+    this.count = 0
+    this.partial = ''
+  }
+
+  push (line) {
+    if (this.count < this.capacity) {
+      this.lines[(this.start + this.count) % this.capacity] = line
+      this.count += 1
+    } else {
+      this.lines[this.start] = line
+      this.start = (this.start + 1) % this.capacity
+    }
+  }
+
+  append (text) {
+    const pieces = text.split('\n')
+    pieces[0] = this.partial + pieces[0]
+    this.partial = pieces.pop()
+    for (const line of pieces) {
+      this.push(line)
+    }
+    this.schedule()
+  }
+
+  size () {
+    return this.count + (this.partial ? 1 : 0)
+  }
+
+  renderRows (first, last) {
+    const rows = []
+    for (let i = first; i < last; i++) {
+      rows.push(i < this.count ? this.lines[(this.start + i) % this.capacity] : this.partial)
+    }
+    this.pre.style.top = (first * LINE_HEIGHT) + 'px'
+    this.pre.textContent = rows.join('\n')
+  }
+}
+
+// Grid over a BatchStore, one table row per LINE_HEIGHT plus a sticky header
+class TableView extends VirtualView {
+  constructor (container, info, store) {
+    super(container)
+    this.store = store
+    this.follow = false
+    this.info = info
+    this.info.style.display = 'block'
+    this.table = document.createElement('table')
+    this.table.className = 'table is-narrow'
+    this.container.appendChild(this.table)
+  }
+
+  size () {
+    this.store.seal()
+    return this.store.length + 1
+  }
+
+  renderRows (first, last) {
+    const store = this.store
+    const names = store.names
+    const thead = document.createElement('thead')
+    const header = thead.insertRow()
+    ;['#'].concat(names).forEach(name => {
+      const th = document.createElement('th')
+      th.textContent = name
+      header.appendChild(th)
+    })
+    const tbody = document.createElement('tbody')
+    for (let i = first; i < Math.min(last, store.length); i++) {
+      const [batch, row] = store.locate(i)
+      const tr = tbody.insertRow()
+      tr.insertCell().textContent = i + 1
+      names.forEach(name => {
+        const value = batch.get(row, name)
+        tr.insertCell().textContent = value === null ? '' : value
+      })
+    }
+    this.table.replaceChildren(thead, tbody)
+    this.table.style.top = (first * LINE_HEIGHT) + 'px'
+    this.info.textContent = store.seen > store.length
+      ? `Showing ${store.length} of ${store.seen} rows`
+      : `${store.length} rows`
+  }
+}
+
+module.exports = {
+  LINE_HEIGHT,
+  VirtualView,
+  TextView,
+  TableView
+}
@@ -0,0 +1,61 @@
+// Fixed-size pool of dedicated workers, one task per worker at a time
+class WorkerPool {
+  constructor (createWorker, size) {
+    this.size = size || (typeof navigator !== 'undefined' && navigator.hardwareConcurrency) || 4
+    this.workers = []
+    this.idle = []
+    this.queue = []
+    this.tasks = new Map()
+    this.taskId = 0
+    for (let i = 0; i < this.size; i++) {
+      const worker = createWorker()
+      worker.onmessage = (e) => this._done(worker, e.data)
+      worker.onerror = (e) => this._done(worker, { id: worker.taskId, error: e.message })
+      this.workers.push(worker)
+      this.idle.push(worker)
+    }
+  }
+
+  run (message, transfer) {
+    return new Promise((resolve, reject) => {
+      const id = ++this.taskId
+      this.tasks.set(id, { resolve, reject })
+      this.queue.push({ message: Object.assign({ id }, message), transfer })
+      this._next()
+    })
+  }
+
+  terminate () {
+    this.workers.forEach(worker => worker.terminate())
+    this.tasks.forEach(task => task.reject(new Error('Worker pool terminated')))
+    this.tasks.clear()
+    this.queue = []
+  }
+
+  _next () {
+    while (this.idle.length && this.queue.length) {
+      const worker = this.idle.pop()
+      const { message, transfer } = this.queue.shift()
+      worker.taskId = message.id
+      worker.postMessage(message, transfer || [])
+    }
+  }
+
+  _done (worker, data) {
+    const task = this.tasks.get(data.id)
+    this.tasks.delete(data.id)
+    this.idle.push(worker)
+    if (task) {
+      if (data.error) {
+        task.reject(new Error(data.error))
+      } else {
+        task.resolve(data.result)
+      }
+    }
+    this._next()
+  }
+}
+
+module.exports = {
+  WorkerPool
+}
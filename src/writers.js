@@ -0,0 +1,236 @@
+// Serializers and file sinks for FileOutput. Text is coalesced into large writes,
+// and the next chunk is only accepted once the sink has taken the previous write.
+// Binary serializers (Arrow, Parquet) set `binary` and return bytes instead of text.
+const fs = require('fs')
+const through2 = require('through2')
+const { saveAs } = require('file-saver')
+const { RecordBatch } = require('./batch')
+const { concatBytes } = require('./columnar')
+
+const WRITE_SIZE = 1024 * 1024 // characters, or bytes, per sink write
+const BLOB_PARTS = 64 // writes folded into one Blob on the download path
+
+// Text, bytes, or one JSON line per record
+function toText (chunk, decoder) {
+  if (typeof chunk === 'string') {
+    return chunk
+  } else if (chunk instanceof Uint8Array) {
+    return decoder.decode(chunk, {stream: true})
+  } else if (RecordBatch.isBatch(chunk)) {
+    return chunk.toObjects().map(r => JSON.stringify(r) + '\n').join('')
+  }
+  return JSON.stringify(chunk) + '\n'
+}
+
+class NDJSONSerializer {
+  constructor () {
+    this.decoder = new TextDecoder()
+  }
+
+  serialize (chunk) {
+    return toText(chunk, this.decoder)
+  }
+
+  end () {
+    return this.decoder.decode()
+  }
+}
+
+const HEADER_SAMPLE = 1000 // records held to collect the header from
+
+// Columns are fixed by the first batch, or by the fields of the first records together,
+// later fields not in the header are dropped
+class CSVSerializer {
+  constructor (delimiter) {
+    this.delimiter = delimiter || ','
+    this.columns = null
+    this.sample = []
+    this.decoder = new TextDecoder()
+    this.special = new RegExp(`["\\r\\n${this.delimiter.replace(/[\\\]^-]/g, '\\$&')}]`)
+  }
+
+  field (value) {
+    if (value === null || typeof value === 'undefined' || value !== value) return ''
+    const s = String(value)
+    return this.special.test(s) ? '"' + s.replace(/"/g, '""') + '"' : s
+  }
+
+  header (names) {
+    this.columns = names
+    return names.map(name => this.field(name)).join(this.delimiter) + '\n'
+  }
+
+  row (record) {
+    return this.columns.map(name => this.field(record[name])).join(this.delimiter) + '\n'
+  }
+
+  // Header over the keys of the held records, in order of first appearance, then the records
+  flushSample () {
+    const names = new Set()
+    this.sample.forEach(record => Object.keys(record).forEach(name => names.add(name)))
+    let text = this.header(Array.from(names))
+    this.sample.forEach(record => { text += this.row(record) })
+    this.sample = []
+    return text
+  }
+
+  serialize (chunk) {
+    if (typeof chunk === 'string' || chunk instanceof Uint8Array) {
+      return toText(chunk, this.decoder)
+    }
+    let text = ''
+    if (RecordBatch.isBatch(chunk)) {
+      if (!this.columns) {
+        text += this.sample.length ? this.flushSample() : this.header(chunk.names)
+      }
+      const columns = this.columns.map(name => chunk.column(name))
+      for (let i = 0; i < chunk.length; i++) {
+        text += columns.map(c => c ? this.field(c.get(i)) : '').join(this.delimiter) + '\n'
+      }
+      return text
+    }
+    if (!this.columns) {
+      this.sample.push(chunk)
+      return this.sample.length >= HEADER_SAMPLE ? this.flushSample() : ''
+    }
+    return this.row(chunk)
+  }
+
+  end () {
+    const text = this.sample.length ? this.flushSample() : ''
+    return text + this.decoder.decode()
+  }
+}
+
+// File System Access API, written to disk as it goes
+class WritableSink {
+  constructor (writable) {
+    this.writable = writable
+  }
+
+  write (text) {
+    return this.writable.write(text)
+  }
+
+  close () {
+    return this.writable.close()
+  }
+}
+
+// Streamed download fallback. Parts are folded into Blobs as they come,
+// which the browser can keep out of the JS heap, and saved with file-saver at the end.
+class DownloadSink {
+  constructor (name, type) {
+    this.name = name
+    this.type = type
+    this.blobs = []
+    this.parts = []
+  }
+
+  async write (text) {
+    this.parts.push(text)
+    if (this.parts.length >= BLOB_PARTS) {
+      this.blobs.push(new Blob(this.parts))
+      this.parts = []
+    }
+  }
+
+  async close () {
+    saveAs(new Blob(this.blobs.concat(this.parts), { type: this.type }), this.name)
+    this.blobs = []
+    this.parts = []
+  }
+}
+
+// Headless runs write the named file with native fs streams
+class NodeFileSink {
+  constructor (path) {
+    this.out = fs.createWriteStream(path)
+  }
+
+  write (text) {
+    return new Promise((resolve, reject) => {
+      this.out.write(text, err => err ? reject(err) : resolve())
+    })
+  }
+
+  close () {
+    return new Promise((resolve, reject) => {
+      this.out.end(err => err ? reject(err) : resolve())
+    })
+  }
+}
+
+const isNode = () => typeof window === 'undefined' && typeof process !== 'undefined' && !!(process.versions && process.versions.node)
+
+async function openSink (name, binary) {
+  if (isNode()) {
+    return new NodeFileSink(name)
+  }
+  if (typeof window !== 'undefined' && window.showSaveFilePicker) {
+    const handle = await window.showSaveFilePicker({ suggestedName: name })
+    return new WritableSink(await handle.createWritable())
+  }
+  return new DownloadSink(name, binary ? 'application/octet-stream' : 'text/plain;charset=utf-8')
+}
+
+class FileWriter {
+  constructor (serializer, sink) {
+    this.serializer = serializer
+    this.sink = sink
+    this.parts = []
+    this.size = 0
+  }
+
+  flush () {
+    const data = this.serializer.binary ? concatBytes(this.parts) : this.parts.join('')
+    this.parts = []
+    this.size = 0
+    return data.length ? this.sink.write(data) : Promise.resolve()
+  }
+
+  // Resolves once the chunk is buffered or, for a full buffer, written
+  write (chunk) {
+    const text = this.serializer.serialize(chunk)
+    this.parts.push(text)
+    this.size += text.length
+    return this.size >= WRITE_SIZE ? this.flush() : Promise.resolve()
+  }
+
+  async end () {
+    this.parts.push(this.serializer.end())
+    await this.flush()
+    await this.sink.close()
+  }
+}
+
+// Output stages without a DOM print to stdout, waiting on it when it's full.
+// A reader closing early (tranfi ... | head) destroys the stream without an error.
+function stdoutStream () {
+  const decoder = new TextDecoder()
+  const stream = through2.obj(function (chunk, enc, callback) {
+    this.push(chunk)
+    if (process.stdout.write(toText(chunk, decoder))) {
+      callback()
+    } else {
+      process.stdout.once('drain', () => callback())
+    }
+  }, function (callback) {
+    process.stdout.write(decoder.decode())
+    callback()
+  })
+  const onError = (err) => stream.destroy(err.code === 'EPIPE' ? null : err)
+  process.stdout.on('error', onError)
+  stream.on('close', () => process.stdout.removeListener('error', onError))
+  return stream
+}
+
+module.exports = {
+  toText,
+  isNode,
+  stdoutStream,
+  NDJSONSerializer,
+  CSVSerializer,
+  openSink,
+  FileWriter
+}
@@ -0,0 +1,52 @@
+// Arrow and Parquet files written by the FileOutput serializers and read back by the parsers
+const { readArrow, ArrowSerializer } = require('../src/arrow')
+const { readParquet, ParquetSerializer } = require('../src/parquet')
+const { openSource, concatBytes } = require('../src/columnar')
+
+const RECORDS = Array.from({ length: 2500 }, (_, i) => ({
+  id: i,
+  name: i % 7 ? 'n' + (i % 13) : null,
+  score: i % 5 ? i / 4 : null
+}))
+
+function serialize (serializer, records) {
+  const parts = records.map(record => serializer.serialize(record))
+  parts.push(serializer.end())
+  return concatBytes(parts)
+}
+
+async function read (reader, bytes, options = {}) {
+  const records = []
+  const source = openSource(bytes)
+  for await (const { batches } of reader(source, () => {}, Object.assign({ batchSize: 1024 }, options))) {
+    batches.forEach(batch => records.push(...batch.toObjects()))
+  }
+  return records
+}
+
+describe('Arrow', () => {
+  test('round trips numbers, strings and nulls', async () => {
+    expect(await read(readArrow, serialize(new ArrowSerializer(), RECORDS))).toEqual(RECORDS)
+  })
+
+  test('reads only the requested fields', async () => {
+    const records = await read(readArrow, serialize(new ArrowSerializer(), RECORDS), { fields: ['name'] })
+    expect(records).toEqual(RECORDS.map(r => ({ name: r.name })))
+  })
+})
+
+describe('Parquet', () => {
+  test('round trips numbers, strings and nulls over several row groups', async () => {
+    expect(await read(readParquet, serialize(new ParquetSerializer(1000), RECORDS))).toEqual(RECORDS)
+  })
+
+  test('applies a pushed down filter with the requested fields', async () => {
+    const bytes = serialize(new ParquetSerializer(1000), RECORDS)
+    const records = await read(readParquet, bytes, { fields: ['id'], filter: 'id >= 2100' })
+    expect(records).toEqual(RECORDS.filter(r => r.id >= 2100).map(r => ({ id: r.id })))
+  })
+
+  test('writes a readable file without records', async () => {
+    expect(await read(readParquet, serialize(new ParquetSerializer(), []))).toEqual([])
+  })
+})
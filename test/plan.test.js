@@ -0,0 +1,60 @@
+// What the planner fuses into parsers and which fields it asks them for
+const { plan } = require('../src/pipeline')
+
+const stage = (id, name, params = {}) => ({ id, name, params })
+const loader = stage(0, 'FileLoader', { 'File': 'data', 'Encoding': 'UTF-8' })
+
+describe('plan', () => {
+  test('fuses filters into CSVParser and pushes the selected fields', () => {
+    const planned = plan([
+      loader,
+      stage(1, 'CSVParser', { 'Engine': 'Fast' }),
+      stage(2, 'Filter', { 'Expression': 'v > 1' }),
+      stage(3, 'Filter', { 'Expression': 'cat == "a"' }),
+      stage(4, 'Select', { 'Fields': 'id, cat' })
+    ])
+    expect(planned.map(s => s.name)).toEqual(['FileLoader', 'CSVParser', 'Select'])
+    expect(planned[1].id).toBe(1)
+    expect(planned[1].params['Filter']).toBe('(v > 1) and (cat == "a")')
+    expect(planned[1].params['Fields']).toEqual(['id', 'cat'])
+  })
+
+  test('keeps filters and projections out of parsers without pushdown', () => {
+    const stages = [
+      loader,
+      stage(1, 'CSVParser', { 'Engine': 'Fast' }),
+      stage(2, 'Filter', { 'Expression': 'v > 1' }),
+      stage(3, 'Select', { 'Fields': 'id' })
+    ]
+    expect(plan(stages, null, false)).toEqual(stages)
+  })
+
+  test('reads columnar files by range and asks for the fields computed ones need', () => {
+    const planned = plan([
+      loader,
+      stage(1, 'ParquetParser'),
+      stage(2, 'Filter', { 'Expression': 'v > 1' }),
+      stage(3, 'Compute', { 'Columns': 'w = v * 2' }),
+      stage(4, 'Select', { 'Fields': 'id, w' })
+    ])
+    expect(planned.map(s => s.name)).toEqual(['ParquetParser', 'Compute', 'Select'])
+    expect(planned[0].params).toEqual({ 'File': 'data', 'Filter': 'v > 1', 'Fields': ['id', 'v'] })
+  })
+
+  test('asks for every field when a later stage reads them all', () => {
+    const planned = plan([loader, stage(1, 'ArrowParser'), stage(2, 'Sort', { 'Sort by': 'id' })])
+    expect(planned.map(s => s.name)).toEqual(['ArrowParser', 'Sort'])
+    expect(planned[0].params['Fields']).toBeUndefined()
+  })
+
+  test('switches the loader to binary chunks for binary parsers', () => {
+    const planned = plan([stage(0, 'FileLoader', { 'Encoding': 'UTF-8' }), stage(1, 'ArrowParser')])
+    expect(planned[0].params['Encoding']).toBe('Binary')
+  })
+
+  test('hands the file to parallel parsers unless the loader samples it', () => {
+    expect(plan([loader, stage(1, 'CSVParser', { 'Parallel': true })]).map(s => s.name)).toEqual(['CSVParser'])
+    const sampled = stage(0, 'FileLoader', { 'File': 'data', 'Sample': true })
+    expect(plan([sampled, stage(1, 'CSVParser', { 'Parallel': true })]).map(s => s.name)).toEqual(['FileLoader', 'CSVParser'])
+  })
+})
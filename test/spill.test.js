@@ -0,0 +1,60 @@
+// Sort and GroupBy past their in-memory limits, merged back from spill files
+const { ExternalSort } = require('../src/sort')
+const { parseAggregates, HashAggregation } = require('../src/aggregate')
+
+const ROWS = Array.from({ length: 5000 }, (_, i) => ({ id: i, key: 'k' + (i * 7919 % 300), v: (i * 31) % 97 }))
+
+async function collect (iterator) {
+  const rows = []
+  for await (const chunk of iterator) rows.push(...chunk)
+  return rows
+}
+
+describe('ExternalSort', () => {
+  test('merges spilled runs in order', async () => {
+    const sort = new ExternalSort('-v, id', 400)
+    for (const row of ROWS) {
+      sort.add(row)
+      if (sort.overBudget) await sort.spill()
+    }
+    expect(sort.runs.length).toBeGreaterThan(1)
+    const expected = ROWS.slice().sort((a, b) => b.v - a.v || a.id - b.id)
+    expect(await collect(sort.results())).toEqual(expected)
+    expect(sort.runs).toEqual([])
+  })
+
+  test('drops its runs when removed before the results', async () => {
+    const sort = new ExternalSort('id', 400)
+    for (const row of ROWS) {
+      sort.add(row)
+      if (sort.overBudget) await sort.spill()
+    }
+    await sort.remove()
+    expect(sort.runs).toEqual([])
+  })
+})
+
+describe('HashAggregation', () => {
+  const aggregate = async (maxGroups) => {
+    const aggregation = new HashAggregation(['key'], parseAggregates('count, sum(v), min(v), distinct(v)'), maxGroups)
+    let spills = 0
+    for (const row of ROWS) {
+      aggregation.addRecord(row)
+      if (aggregation.overBudget) {
+        await aggregation.spill()
+        spills++
+      }
+    }
+    const rows = await collect(aggregation.results())
+    return { spills, rows: rows.sort((a, b) => a.key < b.key ? -1 : a.key > b.key ? 1 : 0) }
+  }
+
+  test('merges spilled partitions into the groups it would hold in memory', async () => {
+    const spilled = await aggregate(50)
+    const held = await aggregate(100000)
+    expect(spilled.spills).toBeGreaterThan(0)
+    expect(held.spills).toBe(0)
+    expect(spilled.rows).toHaveLength(300)
+    expect(spilled.rows).toEqual(held.rows)
+  })
+})
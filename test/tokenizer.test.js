@@ -0,0 +1,44 @@
+// The Fast engine's tokenizer against csv-parse, over the same options CSVParser passes both
+const parse = require('csv-parse/lib/sync')
+const { CSVTokenizer } = require('../src/tokenizer')
+
+const OPTIONS = { delimiter: ',', comment: '#', relax_column_count: true, skip_empty_lines: true }
+
+const INPUTS = {
+  quoted: 'a,"b,c",d\n"x ""y""",2,"multi\nline"\n"",,"z"\n',
+  crlf: 'a,b\r\n1,2\r\n"q\r\nq",3\r\nlast,row',
+  comments: '# head\na,b\n1,2# tail\n3,"#not",4\n\n# end'
+}
+
+// Records of the input written in chunks of `size` bytes, the whole input for 0
+function tokenize (input, size) {
+  const bytes = Buffer.from(input)
+  const tokenizer = CSVTokenizer.fromParseOptions(OPTIONS)
+  const records = []
+  const emit = (values) => records.push(values)
+  for (let i = 0; i < bytes.length; i += size || bytes.length) {
+    tokenizer.write(bytes.subarray(i, size ? i + size : bytes.length), emit)
+  }
+  tokenizer.end(emit)
+  return records
+}
+
+describe('CSVTokenizer', () => {
+  Object.keys(INPUTS).forEach(name => {
+    test(`matches csv-parse on ${name} input at any chunk boundary`, () => {
+      const expected = parse(INPUTS[name], OPTIONS)
+      for (let size = 0; size <= 11; size++) {
+        expect(tokenize(INPUTS[name], size)).toEqual(expected)
+      }
+    })
+  })
+
+  test('decodes only the requested columns', () => {
+    const tokenizer = new CSVTokenizer()
+    tokenizer.columns([1])
+    const records = []
+    tokenizer.write('a,b,c\n1,2,3\n', values => records.push(values))
+    expect(records.map(r => r[1])).toEqual(['b', '2'])
+    expect(records[0][0]).toBeUndefined()
+  })
+})
@@ -73,6 +73,8 @@ module.exports = (env) => {
     resolve: {
       fallback: {
         'buffer': require.resolve('buffer'),
+        // Only used by headless runs under Node
+        'fs': false,
         'stream': require.resolve('stream-browserify'),
         'url': require.resolve('url')
       },